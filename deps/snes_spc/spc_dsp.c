@@ -24,8 +24,16 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define SPC_SSE2
+#elif defined(__ARM_NEON)
+    #include <arm_neon.h>
+#endif
+
 #include "spc_dsp.h"
 
 // DSP register addresses
@@ -67,7 +75,7 @@ typedef enum _env_mode_t {
 } env_mode_t;
 
 typedef struct _voice_t {
-    int buf[SPC_BRR_BUF_SIZE*2];// decoded samples (twice the size to simplify wrap handling)
+    int16_t buf[SPC_BRR_BUF_SIZE*2];// decoded samples (twice the size to simplify wrap handling)
     int buf_pos;            // place in buffer where next samples will be decoded
     int interp_pos;         // relative fractional position in sample (0x1000 = 1.0)
     int brr_addr;           // address of current BRR block
@@ -81,7 +89,7 @@ typedef struct _voice_t {
     uint8_t t_envx_out;
 } voice_t;
 
-typedef struct _state_t {
+struct _spc_dsp_t {
     uint8_t regs[SPC_REGISTER_COUNT];
 
     // Echo history keeps most recent 8 samples (twice the size to simplify wrap handling)
@@ -141,11 +149,9 @@ typedef struct _state_t {
     int16_t* out_end;
     int16_t* out_begin;
     int16_t extra[SPC_EXTRA_SIZE];
-} state_t;
-
-static state_t m;
-
-static int interp_algo = 0;
+    int interp_algo;
+    unsigned char echo_pages[0x100]; // RAM pages written by echo, see header
+};
 
 // CPU Byte Order Utilities
 
@@ -491,14 +497,30 @@ static short const sinc[2048] =
    -38,    41,  -328,   718, 15642,   613,  -302,    38,
 };
 
-static inline int interpolate(voice_t const* v) {
-    int const* in = &v->buf[(v->interp_pos >> 12) + v->buf_pos];
+static inline int interpolate(spc_dsp_t* const m, voice_t const* v) {
+    int16_t const* in = &v->buf[(v->interp_pos >> 12) + v->buf_pos];
     int out = 0;
 
-    if (interp_algo) { // Sinc
+    if (m->interp_algo) { // Sinc
         int offset = (v->interp_pos & 0xFF0) >> 1;
         short const* filt = sinc + offset;
 
+        // Samples and coefficients are both 16-bit, so the 8-tap sum is one
+        // multiply-add of two vectors followed by a horizontal add
+    #if defined(SPC_SSE2)
+        __m128i p = _mm_madd_epi16(_mm_loadu_si128((__m128i const*)filt),
+            _mm_loadu_si128((__m128i const*)in));
+        p = _mm_add_epi32(p, _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 0, 3, 2)));
+        p = _mm_add_epi32(p, _mm_shuffle_epi32(p, _MM_SHUFFLE(2, 3, 0, 1)));
+        out = _mm_cvtsi128_si32(p);
+    #elif defined(__ARM_NEON)
+        int16x8_t f = vld1q_s16(filt);
+        int16x8_t x = vld1q_s16(in);
+        int32x4_t p = vmull_s16(vget_low_s16(f), vget_low_s16(x));
+        p = vmlal_s16(p, vget_high_s16(f), vget_high_s16(x));
+        int32x2_t h = vadd_s32(vget_low_s32(p), vget_high_s32(p));
+        out = vget_lane_s32(vpadd_s32(h, h), 0);
+    #else
         out  = filt [0] * in [0];
         out += filt [1] * in [1];
         out += filt [2] * in [2];
@@ -507,6 +529,7 @@ static inline int interpolate(voice_t const* v) {
         out += filt [5] * in [5];
         out += filt [6] * in [6];
         out += filt [7] * in [7];
+    #endif
         out >>= 14;
 
         CLAMP16( out );
@@ -567,13 +590,13 @@ static unsigned const counter_offsets[32] =
          0
 };
 
-static inline unsigned read_counter(int rate) {
-    return ((unsigned)m.counter + counter_offsets[rate]) % counter_rates[rate];
+static inline unsigned read_counter(spc_dsp_t* const m, int rate) {
+    return ((unsigned)m->counter + counter_offsets[rate]) % counter_rates[rate];
 }
 
 //// Envelope
 
-static inline void run_envelope(voice_t* const v) {
+static inline void run_envelope(spc_dsp_t* const m, voice_t* const v) {
     int env = v->env;
     if (v->env_mode == env_release) { // 60%
         if ((env -= 0x8) < 0)
@@ -583,16 +606,16 @@ static inline void run_envelope(voice_t* const v) {
     else {
         int rate;
         int env_data = v->regs[v_adsr1];
-        if (m.t_adsr0 & 0x80) { // 99% ADSR
+        if (m->t_adsr0 & 0x80) { // 99% ADSR
             if (v->env_mode >= env_decay) { // 99%
                 env--;
                 env -= env >> 8;
                 rate = env_data & 0x1F;
                 if (v->env_mode == env_decay) // 1%
-                    rate = (m.t_adsr0 >> 3 & 0x0E) + 0x10;
+                    rate = (m->t_adsr0 >> 3 & 0x0E) + 0x10;
             }
             else { // env_attack
-                rate = (m.t_adsr0 & 0x0F) * 2 + 1;
+                rate = (m->t_adsr0 & 0x0F) * 2 + 1;
                 env += rate < 31 ? 0x20 : 0x400;
             }
         }
@@ -634,22 +657,22 @@ static inline void run_envelope(voice_t* const v) {
                 v->env_mode = env_decay;
         }
 
-        if (!read_counter(rate))
+        if (!read_counter(m, rate))
             v->env = env; // nothing else is controlled by the counter
     }
 }
 
 //// BRR Decoding
 
-static inline void decode_brr(voice_t* v) {
+static inline void decode_brr(spc_dsp_t* const m, voice_t* v) {
     // Arrange the four input nybbles in 0xABCD order for easy decoding
-    int nybbles = m.t_brr_byte * 0x100 + m.ram[(v->brr_addr + v->brr_offset + 1) & 0xFFFF];
+    int nybbles = m->t_brr_byte * 0x100 + m->ram[(v->brr_addr + v->brr_offset + 1) & 0xFFFF];
 
-    int const header = m.t_brr_header;
+    int const header = m->t_brr_header;
 
     // Write to next four samples in circular buffer
-    int* pos = &v->buf[v->buf_pos];
-    int* end;
+    int16_t* pos = &v->buf[v->buf_pos];
+    int16_t* end;
     if ((v->buf_pos += 4) >= SPC_BRR_BUF_SIZE)
         v->buf_pos = 0;
 
@@ -694,80 +717,80 @@ static inline void decode_brr(voice_t* v) {
 
 //// Misc
 
-static inline void misc_27(void) {
-    m.t_pmon = m.regs[r_pmon] & 0xFE; // voice 0 doesn't support PMON
+static inline void misc_27(spc_dsp_t* const m) {
+    m->t_pmon = m->regs[r_pmon] & 0xFE; // voice 0 doesn't support PMON
 }
 
-static inline void misc_28(void) {
-    m.t_non = m.regs[r_non];
-    m.t_eon = m.regs[r_eon];
-    m.t_dir = m.regs[r_dir];
+static inline void misc_28(spc_dsp_t* const m) {
+    m->t_non = m->regs[r_non];
+    m->t_eon = m->regs[r_eon];
+    m->t_dir = m->regs[r_dir];
 }
 
-static inline void misc_29(void) {
-    if ((m.every_other_sample ^= 1) != 0)
-        m.new_kon &= ~m.kon; // clears KON 63 clocks after it was last read
+static inline void misc_29(spc_dsp_t* const m) {
+    if ((m->every_other_sample ^= 1) != 0)
+        m->new_kon &= ~m->kon; // clears KON 63 clocks after it was last read
 }
 
-static inline void misc_30(void) {
-    if (m.every_other_sample) {
-        m.kon    = m.new_kon;
-        m.t_koff = m.regs[r_koff];
+static inline void misc_30(spc_dsp_t* const m) {
+    if (m->every_other_sample) {
+        m->kon    = m->new_kon;
+        m->t_koff = m->regs[r_koff];
     }
 
-    if (--m.counter < 0)
-        m.counter = simple_counter_range - 1;
+    if (--m->counter < 0)
+        m->counter = simple_counter_range - 1;
 
     // Noise
-    if (!read_counter(m.regs[r_flg] & 0x1F)) {
-        int feedback = (m.noise << 13) ^ (m.noise << 14);
-        m.noise = (feedback & 0x4000) ^ (m.noise >> 1);
+    if (!read_counter(m, m->regs[r_flg] & 0x1F)) {
+        int feedback = (m->noise << 13) ^ (m->noise << 14);
+        m->noise = (feedback & 0x4000) ^ (m->noise >> 1);
     }
 }
 
 //// Voices
 
-static inline void voice_V1(voice_t* const v) {
-    m.t_dir_addr = m.t_dir * 0x100 + m.t_srcn * 4;
-    m.t_srcn = v->regs[v_srcn];
+static inline void voice_V1(spc_dsp_t* const m, voice_t* const v) {
+    m->t_dir_addr = m->t_dir * 0x100 + m->t_srcn * 4;
+    m->t_srcn = v->regs[v_srcn];
 }
 
-static inline void voice_V2(voice_t* const v) {
+static inline void voice_V2(spc_dsp_t* const m, voice_t* const v) {
     // Read sample pointer (ignored if not needed)
-    uint8_t const* entry = &m.ram[m.t_dir_addr];
+    uint8_t const* entry = &m->ram[m->t_dir_addr];
     if (!v->kon_delay)
         entry += 2;
-    m.t_brr_next_addr = get_le16(entry);
+    m->t_brr_next_addr = get_le16(entry);
 
-    m.t_adsr0 = v->regs[v_adsr0];
+    m->t_adsr0 = v->regs[v_adsr0];
 
     // Read pitch, spread over two clocks
-    m.t_pitch = v->regs[v_pitchl];
+    m->t_pitch = v->regs[v_pitchl];
 }
 
-static inline void voice_V3a(voice_t* const v) {
-    m.t_pitch += (v->regs[v_pitchh] & 0x3F) << 8;
+static inline void voice_V3a(spc_dsp_t* const m, voice_t* const v) {
+    m->t_pitch += (v->regs[v_pitchh] & 0x3F) << 8;
 }
 
-static inline void voice_V3b(voice_t* const v) {
+static inline void voice_V3b(spc_dsp_t* const m, voice_t* const v) {
     // Read BRR header and byte
-    m.t_brr_byte   = m.ram[(v->brr_addr + v->brr_offset) & 0xFFFF];
-    m.t_brr_header = m.ram[v->brr_addr]; // brr_addr doesn't need masking
+    m->t_brr_byte   = m->ram[(v->brr_addr + v->brr_offset) & 0xFFFF];
+    m->t_brr_header = m->ram[v->brr_addr]; // brr_addr doesn't need masking
 }
 
-static inline void voice_V3c(voice_t* const v) {
+static inline void voice_V3c(spc_dsp_t* const m, voice_t* const v) {
     // Pitch modulation using previous voice's output
-    if (m.t_pmon & v->vbit)
-        m.t_pitch += ((m.t_output >> 5) * m.t_pitch) >> 10;
+    if (m->t_pmon & v->vbit)
+        m->t_pitch += ((m->t_output >> 5) * m->t_pitch) >> 10;
 
     if (v->kon_delay) {
         // Get ready to start BRR decoding on next sample
         if (v->kon_delay == 5) {
-            v->brr_addr    = m.t_brr_next_addr;
+            v->brr_addr    = m->t_brr_next_addr;
             v->brr_offset  = 1;
             v->buf_pos     = 0;
-            m.t_brr_header = 0; // header is ignored on this sample
-            m.kon_check    = true;
+            m->t_brr_header = 0; // header is ignored on this sample
+            m->kon_check    = true;
         }
 
         // Envelope is never run during KON
@@ -780,35 +803,35 @@ static inline void voice_V3c(voice_t* const v) {
             v->interp_pos = 0x4000;
 
         // Pitch is never added during KON
-        m.t_pitch = 0;
+        m->t_pitch = 0;
     }
 
     // Interpolation
     {
-        int output = interpolate(v);
+        int output = interpolate(m, v);
 
         // Noise
-        if (m.t_non & v->vbit)
-            output = (int16_t)(m.noise * 2);
+        if (m->t_non & v->vbit)
+            output = (int16_t)(m->noise * 2);
 
         // Apply envelope
-        m.t_output = (output * v->env) >> 11 & ~1;
+        m->t_output = (output * v->env) >> 11 & ~1;
         v->t_envx_out = (uint8_t)(v->env >> 4);
     }
 
     // Immediate silence due to end of sample or soft reset
-    if (m.regs[r_flg] & 0x80 || (m.t_brr_header & 3) == 1) {
+    if (m->regs[r_flg] & 0x80 || (m->t_brr_header & 3) == 1) {
         v->env_mode = env_release;
         v->env      = 0;
     }
 
-    if (m.every_other_sample) {
+    if (m->every_other_sample) {
         // KOFF
-        if (m.t_koff & v->vbit)
+        if (m->t_koff & v->vbit)
             v->env_mode = env_release;
 
         // KON
-        if (m.kon & v->vbit) {
+        if (m->kon & v->vbit) {
             v->kon_delay = 5;
             v->env_mode  = env_attack;
         }
@@ -816,170 +839,170 @@ static inline void voice_V3c(voice_t* const v) {
 
     // Run envelope for next sample
     if (!v->kon_delay)
-        run_envelope(v);
+        run_envelope(m, v);
 }
 
-static inline void voice_output(voice_t const* v, int ch) {
+static inline void voice_output(spc_dsp_t* const m, voice_t const* v, int ch) {
     // Apply left/right volume
-    int amp = (m.t_output * (int8_t)v->regs[v_voll + ch]) >> 7;
+    int amp = (m->t_output * (int8_t)v->regs[v_voll + ch]) >> 7;
 
     // Add to output total
-    m.t_main_out[ch] += amp;
-    CLAMP16(m.t_main_out[ch]);
+    m->t_main_out[ch] += amp;
+    CLAMP16(m->t_main_out[ch]);
 
     // Optionally add to echo total
-    if (m.t_eon & v->vbit) {
-        m.t_echo_out[ch] += amp;
-        CLAMP16(m.t_echo_out[ch]);
+    if (m->t_eon & v->vbit) {
+        m->t_echo_out[ch] += amp;
+        CLAMP16(m->t_echo_out[ch]);
     }
 }
 
-static inline void voice_V4(voice_t* const v) {
+static inline void voice_V4(spc_dsp_t* const m, voice_t* const v) {
     // Decode BRR
-    m.t_looped = 0;
+    m->t_looped = 0;
     if (v->interp_pos >= 0x4000) {
-        decode_brr(v);
+        decode_brr(m, v);
 
         if ((v->brr_offset += 2) >= SPC_BRR_BLOCK_SIZE) {
             // Start decoding next BRR block
             assert(v->brr_offset == SPC_BRR_BLOCK_SIZE);
             v->brr_addr = (v->brr_addr + SPC_BRR_BLOCK_SIZE) & 0xFFFF;
-            if (m.t_brr_header & 1)
+            if (m->t_brr_header & 1)
             {
-                v->brr_addr = m.t_brr_next_addr;
-                m.t_looped = v->vbit;
+                v->brr_addr = m->t_brr_next_addr;
+                m->t_looped = v->vbit;
             }
             v->brr_offset = 1;
         }
     }
 
     // Apply pitch
-    v->interp_pos = (v->interp_pos & 0x3FFF) + m.t_pitch;
+    v->interp_pos = (v->interp_pos & 0x3FFF) + m->t_pitch;
 
     // Keep from getting too far ahead (when using pitch modulation)
     if (v->interp_pos > 0x7FFF)
         v->interp_pos = 0x7FFF;
 
     // Output left
-    voice_output(v, 0);
+    voice_output(m, v, 0);
 }
 
-static inline void voice_V5(voice_t* const v) {
+static inline void voice_V5(spc_dsp_t* const m, voice_t* const v) {
     // Output right
-    voice_output(v, 1);
+    voice_output(m, v, 1);
 
     // ENDX, OUTX, and ENVX won't update if you wrote to them 1-2 clocks earlier
-    int endx_buf = m.regs[r_endx] | m.t_looped;
+    int endx_buf = m->regs[r_endx] | m->t_looped;
 
     // Clear bit in ENDX if KON just began
     if (v->kon_delay == 5)
         endx_buf &= ~v->vbit;
-    m.endx_buf = (uint8_t)endx_buf;
+    m->endx_buf = (uint8_t)endx_buf;
 }
 
-static inline void voice_V6(voice_t* const v) {
+static inline void voice_V6(spc_dsp_t* const m, voice_t* const v) {
     (void)v; // avoid compiler warning about unused v
-    m.outx_buf = (uint8_t)(m.t_output >> 8);
+    m->outx_buf = (uint8_t)(m->t_output >> 8);
 }
 
-static inline void voice_V7(voice_t* const v) {
+static inline void voice_V7(spc_dsp_t* const m, voice_t* const v) {
     // Update ENDX
-    m.regs[r_endx] = m.endx_buf;
+    m->regs[r_endx] = m->endx_buf;
 
-    m.envx_buf = v->t_envx_out;
+    m->envx_buf = v->t_envx_out;
 }
 
-static inline void voice_V8(voice_t* const v) {
+static inline void voice_V8(spc_dsp_t* const m, voice_t* const v) {
     // Update OUTX
-    v->regs[v_outx] = m.outx_buf;
+    v->regs[v_outx] = m->outx_buf;
 }
 
-static inline void voice_V9(voice_t* const v) {
+static inline void voice_V9(spc_dsp_t* const m, voice_t* const v) {
     // Update ENVX
-    v->regs[v_envx] = m.envx_buf;
+    v->regs[v_envx] = m->envx_buf;
 }
 
 // Most voices do all these in one clock, so make a handy composite
-static inline void voice_V3(voice_t* const v) {
-    voice_V3a(v);
-    voice_V3b(v);
-    voice_V3c(v);
+static inline void voice_V3(spc_dsp_t* const m, voice_t* const v) {
+    voice_V3a(m, v);
+    voice_V3b(m, v);
+    voice_V3c(m, v);
 }
 
 // Common combinations of voice steps on different voices. This greatly reduces
 // code size and allows everything to be inlined in these functions.
-static inline void voice_V7_V4_V1(voice_t* const v) {
-    voice_V7(v);
-    voice_V1(v+3);
-    voice_V4(v+1);
+static inline void voice_V7_V4_V1(spc_dsp_t* const m, voice_t* const v) {
+    voice_V7(m, v);
+    voice_V1(m, v+3);
+    voice_V4(m, v+1);
 }
 
-static inline void voice_V8_V5_V2(voice_t* const v) {
-    voice_V8(v);
-    voice_V5(v+1);
-    voice_V2(v+2);
+static inline void voice_V8_V5_V2(spc_dsp_t* const m, voice_t* const v) {
+    voice_V8(m, v);
+    voice_V5(m, v+1);
+    voice_V2(m, v+2);
 }
 
-static inline void voice_V9_V6_V3(voice_t* const v) {
-    voice_V9(v);
-    voice_V6(v+1);
-    voice_V3(v+2);
+static inline void voice_V9_V6_V3(spc_dsp_t* const m, voice_t* const v) {
+    voice_V9(m, v);
+    voice_V6(m, v+1);
+    voice_V3(m, v+2);
 }
 
 //// Echo
 
 // Current echo buffer pointer for left/right channel
-#define ECHO_PTR(ch)      (&m.ram[m.t_echo_ptr + ch * 2])
+#define ECHO_PTR(ch)      (&m->ram[m->t_echo_ptr + ch * 2])
 
 // Sample in echo history buffer, where 0 is the oldest
-#define ECHO_FIR(i)       (m.echo_hist_pos[i])
+#define ECHO_FIR(i)       (m->echo_hist_pos[i])
 
 // Calculate FIR point for left/right channel
-#define CALC_FIR(i, ch)   ((ECHO_FIR(i + 1)[ch] * (int8_t)m.regs[r_fir + i * 0x10]) >> 6)
+#define CALC_FIR(i, ch)   ((ECHO_FIR(i + 1)[ch] * (int8_t)m->regs[r_fir + i * 0x10]) >> 6)
 
-static inline void echo_read(int ch) {
+static inline void echo_read(spc_dsp_t* const m, int ch) {
     int s = ((int16_t)get_le16(ECHO_PTR(ch)));
     // second copy simplifies wrap-around handling
     ECHO_FIR(0)[ch] = ECHO_FIR(8)[ch] = s >> 1;
 }
 
-static inline void echo_22(void) {
+static inline void echo_22(spc_dsp_t* const m) {
     // History
-    if (++m.echo_hist_pos >= &m.echo_hist[SPC_ECHO_HIST_SIZE])
-        m.echo_hist_pos = m.echo_hist;
+    if (++m->echo_hist_pos >= &m->echo_hist[SPC_ECHO_HIST_SIZE])
+        m->echo_hist_pos = m->echo_hist;
 
-    m.t_echo_ptr = (m.t_esa * 0x100 + m.echo_offset) & 0xFFFF;
-    echo_read(0);
+    m->t_echo_ptr = (m->t_esa * 0x100 + m->echo_offset) & 0xFFFF;
+    echo_read(m, 0);
 
     // FIR (using l and r temporaries below helps compiler optimize)
     int l = CALC_FIR(0, 0);
     int r = CALC_FIR(0, 1);
 
-    m.t_echo_in[0] = l;
-    m.t_echo_in[1] = r;
+    m->t_echo_in[0] = l;
+    m->t_echo_in[1] = r;
 }
 
-static inline void echo_23(void) {
+static inline void echo_23(spc_dsp_t* const m) {
     int l = CALC_FIR(1, 0) + CALC_FIR(2, 0);
     int r = CALC_FIR(1, 1) + CALC_FIR(2, 1);
 
-    m.t_echo_in[0] += l;
-    m.t_echo_in[1] += r;
+    m->t_echo_in[0] += l;
+    m->t_echo_in[1] += r;
 
-    echo_read(1);
+    echo_read(m, 1);
 }
 
-static inline void echo_24(void) {
+static inline void echo_24(spc_dsp_t* const m) {
     int l = CALC_FIR(3, 0) + CALC_FIR(4, 0) + CALC_FIR(5, 0);
     int r = CALC_FIR(3, 1) + CALC_FIR(4, 1) + CALC_FIR(5, 1);
 
-    m.t_echo_in[0] += l;
-    m.t_echo_in[1] += r;
+    m->t_echo_in[0] += l;
+    m->t_echo_in[1] += r;
 }
 
-static inline void echo_25(void) {
-    int l = m.t_echo_in[0] + CALC_FIR(6, 0);
-    int r = m.t_echo_in[1] + CALC_FIR(6, 1);
+static inline void echo_25(spc_dsp_t* const m) {
+    int l = m->t_echo_in[0] + CALC_FIR(6, 0);
+    int r = m->t_echo_in[1] + CALC_FIR(6, 1);
 
     l = (int16_t)l;
     r = (int16_t)r;
@@ -990,94 +1013,96 @@ static inline void echo_25(void) {
     CLAMP16(l);
     CLAMP16(r);
 
-    m.t_echo_in[0] = l & ~1;
-    m.t_echo_in[1] = r & ~1;
+    m->t_echo_in[0] = l & ~1;
+    m->t_echo_in[1] = r & ~1;
 }
 
-static inline int echo_output(int ch) {
-    int out = (int16_t)((m.t_main_out[ch] * (int8_t)m.regs[r_mvoll + ch * 0x10]) >> 7) +
-            (int16_t)((m.t_echo_in[ch] * (int8_t)m.regs[r_evoll + ch * 0x10]) >> 7);
+static inline int echo_output(spc_dsp_t* const m, int ch) {
+    int out = (int16_t)((m->t_main_out[ch] * (int8_t)m->regs[r_mvoll + ch * 0x10]) >> 7) +
+            (int16_t)((m->t_echo_in[ch] * (int8_t)m->regs[r_evoll + ch * 0x10]) >> 7);
     CLAMP16(out);
     return out;
 }
 
-static inline void echo_26(void) {
+static inline void echo_26(spc_dsp_t* const m) {
     // Left output volumes
     // (save sample for next clock so we can output both together)
-    m.t_main_out[0] = echo_output(0);
+    m->t_main_out[0] = echo_output(m, 0);
 
     // Echo feedback
-    int l = m.t_echo_out[0] + (int16_t)((m.t_echo_in[0] * (int8_t)m.regs[r_efb]) >> 7);
-    int r = m.t_echo_out[1] + (int16_t)((m.t_echo_in[1] * (int8_t)m.regs[r_efb]) >> 7);
+    int l = m->t_echo_out[0] + (int16_t)((m->t_echo_in[0] * (int8_t)m->regs[r_efb]) >> 7);
+    int r = m->t_echo_out[1] + (int16_t)((m->t_echo_in[1] * (int8_t)m->regs[r_efb]) >> 7);
 
     CLAMP16(l);
     CLAMP16(r);
 
-    m.t_echo_out[0] = l & ~1;
-    m.t_echo_out[1] = r & ~1;
+    m->t_echo_out[0] = l & ~1;
+    m->t_echo_out[1] = r & ~1;
 }
 
-static inline void echo_27(void) {
+static inline void echo_27(spc_dsp_t* const m) {
     // Output
-    int l = m.t_main_out[0];
-    int r = echo_output(1);
-    m.t_main_out[0] = 0;
-    m.t_main_out[1] = 0;
+    int l = m->t_main_out[0];
+    int r = echo_output(m, 1);
+    m->t_main_out[0] = 0;
+    m->t_main_out[1] = 0;
 
     // TODO: global muting isn't this simple (turns DAC on and off
     // or something, causing small ~37-sample pulse when first muted)
-    if (m.regs[r_flg] & 0x40) {
+    if (m->regs[r_flg] & 0x40) {
         l = 0;
         r = 0;
     }
 
     // Output sample to DAC
-    int16_t* out = m.out;
+    int16_t* out = m->out;
     out[0] = l;
     out[1] = r;
     out += 2;
-    if (out >= m.out_end) {
-        out       = m.extra;
-        m.out_end = &m.extra[SPC_EXTRA_SIZE];
+    if (out >= m->out_end) {
+        out       = m->extra;
+        m->out_end = &m->extra[SPC_EXTRA_SIZE];
     }
-    m.out = out;
+    m->out = out;
 }
 
-static inline void echo_28(void) {
-    m.t_echo_enabled = m.regs[r_flg];
+static inline void echo_28(spc_dsp_t* const m) {
+    m->t_echo_enabled = m->regs[r_flg];
 }
 
-static inline void echo_write(int ch) {
-    if (!(m.t_echo_enabled & 0x20))
-        set_le16(ECHO_PTR(ch), m.t_echo_out[ch]);
-    m.t_echo_out[ch] = 0;
+static inline void echo_write(spc_dsp_t* const m, int ch) {
+    if (!(m->t_echo_enabled & 0x20)) {
+        set_le16(ECHO_PTR(ch), m->t_echo_out[ch]);
+        m->echo_pages[m->t_echo_ptr >> 8] = 1;
+    }
+    m->t_echo_out[ch] = 0;
 }
 
-static inline void echo_29(void) {
-    m.t_esa = m.regs[r_esa];
+static inline void echo_29(spc_dsp_t* const m) {
+    m->t_esa = m->regs[r_esa];
 
-    if (!m.echo_offset)
-        m.echo_length = (m.regs[r_edl] & 0x0F) * 0x800;
+    if (!m->echo_offset)
+        m->echo_length = (m->regs[r_edl] & 0x0F) * 0x800;
 
-    m.echo_offset += 4;
-    if (m.echo_offset >= m.echo_length)
-        m.echo_offset = 0;
+    m->echo_offset += 4;
+    if (m->echo_offset >= m->echo_length)
+        m->echo_offset = 0;
 
     // Write left echo
-    echo_write(0);
+    echo_write(m, 0);
 
-    m.t_echo_enabled = m.regs[r_flg];
+    m->t_echo_enabled = m->regs[r_flg];
 }
 
-static inline void echo_30(void) {
+static inline void echo_30(spc_dsp_t* const m) {
     // Write right echo
-    echo_write(1);
+    echo_write(m, 1);
 }
 
 //// Timing
 
 // Execute clock for a particular voice
-#define V(clock, voice)   voice_##clock(&m.voices[voice]);
+#define V(clock, voice)   voice_##clock(m, &m->voices[voice]);
 
 /* The most common sequence of clocks uses composite operations
 for efficiency. For example, the following are equivalent to the
@@ -1111,26 +1136,26 @@ PHASE(18)                                     V(V8_V5_V2,5)\
 PHASE(19)                                     V(V9_V6_V3,5)\
 PHASE(20)         V(V1,1)                            V(V7,6)V(V4,7)\
 PHASE(21)                                            V(V8,6)V(V5,7)  V(V2,0)  /* t_brr_next_addr order dependency */\
-PHASE(22)  V(V3a,0)                                  V(V9,6)V(V6,7)  echo_22();\
-PHASE(23)                                                   V(V7,7)  echo_23();\
-PHASE(24)                                                   V(V8,7)  echo_24();\
-PHASE(25)  V(V3b,0)                                         V(V9,7)  echo_25();\
-PHASE(26)                                                            echo_26();\
-PHASE(27) misc_27();                                                 echo_27();\
-PHASE(28) misc_28();                                                 echo_28();\
-PHASE(29) misc_29();                                                 echo_29();\
-PHASE(30) misc_30();V(V3c,0)                                         echo_30();\
+PHASE(22)  V(V3a,0)                                  V(V9,6)V(V6,7)  echo_22(m);\
+PHASE(23)                                                   V(V7,7)  echo_23(m);\
+PHASE(24)                                                   V(V8,7)  echo_24(m);\
+PHASE(25)  V(V3b,0)                                         V(V9,7)  echo_25(m);\
+PHASE(26)                                                            echo_26(m);\
+PHASE(27) misc_27(m);                                                echo_27(m);\
+PHASE(28) misc_28(m);                                                echo_28(m);\
+PHASE(29) misc_29(m);                                                echo_29(m);\
+PHASE(30) misc_30(m);V(V3c,0)                                        echo_30(m);\
 PHASE(31)  V(V4,0)       V(V1,2)\
 
-static void soft_reset_common(void) {
-    assert(m.ram); // init() must have been called already
+static void soft_reset_common(spc_dsp_t* const m) {
+    assert(m->ram); // init() must have been called already
 
-    m.noise              = 0x4000;
-    m.echo_hist_pos      = m.echo_hist;
-    m.every_other_sample = 1;
-    m.echo_offset        = 0;
-    m.phase              = 0;
-    m.counter            = 0;
+    m->noise              = 0x4000;
+    m->echo_hist_pos      = m->echo_hist;
+    m->every_other_sample = 1;
+    m->echo_offset        = 0;
+    m->phase              = 0;
+    m->counter            = 0;
 }
 
 static int spc_state_copy_int(unsigned char** buf, dsp_copy_func_t func, int state, int size) {
@@ -1148,97 +1173,109 @@ static int spc_state_copy_int(unsigned char** buf, dsp_copy_func_t func, int sta
 
 //// Setup
 
-void spc_dsp_init(void* ram_64k) {
-    m.ram = (uint8_t*)ram_64k;
-    spc_dsp_set_output(0, 0);
-    spc_dsp_reset();
+spc_dsp_t* spc_dsp_new(void) {
+    return (spc_dsp_t*)calloc(1, sizeof(spc_dsp_t));
 }
 
-void spc_dsp_set_output(int16_t* out, int size) {
+void spc_dsp_delete(spc_dsp_t* m) {
+    free(m);
+}
+
+void spc_dsp_init(spc_dsp_t* m, void* ram_64k) {
+    m->ram = (uint8_t*)ram_64k;
+    spc_dsp_set_output(m, 0, 0);
+    spc_dsp_reset(m);
+}
+
+void spc_dsp_set_output(spc_dsp_t* m, int16_t* out, int size) {
     assert((size & 1) == 0); // must be even
     if (!out) {
-        out  = m.extra;
+        out  = m->extra;
         size = SPC_EXTRA_SIZE;
     }
-    m.out_begin = out;
-    m.out       = out;
-    m.out_end   = out + size;
+    m->out_begin = out;
+    m->out       = out;
+    m->out_end   = out + size;
+}
+
+void spc_dsp_set_interpolation(spc_dsp_t* m, int algo) {
+    m->interp_algo = algo;
 }
 
-void spc_dsp_set_interpolation(int algo) {
-    interp_algo = algo;
+unsigned char* spc_dsp_echo_pages(spc_dsp_t* m) {
+    return m->echo_pages;
 }
 
 //// Emulation
 
-void spc_dsp_reset(void) {
-    memcpy(m.regs, initial_regs, sizeof m.regs);
-    memset(&m.regs[SPC_REGISTER_COUNT], 0, offsetof (state_t,ram) - SPC_REGISTER_COUNT);
+void spc_dsp_reset(spc_dsp_t* m) {
+    memcpy(m->regs, initial_regs, sizeof m->regs);
+    memset(&m->regs[SPC_REGISTER_COUNT], 0, offsetof (spc_dsp_t,ram) - SPC_REGISTER_COUNT);
 
     // Internal state
     for (int i = SPC_VOICE_COUNT; --i >= 0;) {
-        voice_t* v = &m.voices[i];
+        voice_t* v = &m->voices[i];
         v->brr_offset = 1;
         v->vbit       = 1 << i;
-        v->regs       = &m.regs[i * 0x10];
+        v->regs       = &m->regs[i * 0x10];
     }
-    m.new_kon = m.regs[r_kon];
-    m.t_dir   = m.regs[r_dir];
-    m.t_esa   = m.regs[r_esa];
+    m->new_kon = m->regs[r_kon];
+    m->t_dir   = m->regs[r_dir];
+    m->t_esa   = m->regs[r_esa];
 
-    soft_reset_common();
+    soft_reset_common(m);
 }
 
-void spc_dsp_soft_reset(void) {
-    m.regs[r_flg] = 0xE0;
-    soft_reset_common();
+void spc_dsp_soft_reset(spc_dsp_t* m) {
+    m->regs[r_flg] = 0xE0;
+    soft_reset_common(m);
 }
 
 //// Sound control
 
-bool spc_dsp_mute(void) {
-    return m.regs[r_flg] & 0x40;
+bool spc_dsp_mute(spc_dsp_t* m) {
+    return m->regs[r_flg] & 0x40;
 }
 
-int spc_dsp_sample_count(void) {
-    return m.out - m.out_begin;
+int spc_dsp_sample_count(spc_dsp_t* m) {
+    return m->out - m->out_begin;
 }
 
-int spc_dsp_read(int addr) {
+int spc_dsp_read(spc_dsp_t* m, int addr) {
     assert((unsigned)addr < SPC_REGISTER_COUNT);
-    return m.regs[addr];
+    return m->regs[addr];
 }
 
-void spc_dsp_write(int addr, int data) {
+void spc_dsp_write(spc_dsp_t* m, int addr, int data) {
     assert((unsigned)addr < SPC_REGISTER_COUNT);
 
-    m.regs[addr] = (uint8_t)data;
+    m->regs[addr] = (uint8_t)data;
     switch (addr & 0x0F) {
         case v_envx:
-            m.envx_buf = (uint8_t)data;
+            m->envx_buf = (uint8_t)data;
             break;
 
         case v_outx:
-            m.outx_buf = (uint8_t)data;
+            m->outx_buf = (uint8_t)data;
             break;
 
         case 0x0C:
             if (addr == r_kon)
-                m.new_kon = (uint8_t)data;
+                m->new_kon = (uint8_t)data;
 
             if (addr == r_endx) { // always cleared, regardless of data written
-                m.endx_buf = 0;
-                m.regs[r_endx] = 0;
+                m->endx_buf = 0;
+                m->regs[r_endx] = 0;
             }
             break;
     }
 }
 
-void spc_dsp_run(int clocks_remain) {
+void spc_dsp_run(spc_dsp_t* m, int clocks_remain) {
     assert(clocks_remain > 0);
 
-    int const phase = m.phase;
-    m.phase = (phase + clocks_remain) & 31;
+    int const phase = m->phase;
+    m->phase = (phase + clocks_remain) & 31;
     switch (phase) {
     loop:
 
@@ -1255,17 +1292,17 @@ void spc_dsp_run(int clocks_remain) {
 
 //// State
 
-void spc_dsp_copy_state(unsigned char** io, dsp_copy_func_t copy) {
+void spc_dsp_copy_state(spc_dsp_t* m, unsigned char** io, dsp_copy_func_t copy) {
     int extra = 0;
 
     // DSP registers
-    copy(io, m.regs, SPC_REGISTER_COUNT);
+    copy(io, m->regs, SPC_REGISTER_COUNT);
 
     // Internal state
 
     // Voices
     for (int i = 0; i < SPC_VOICE_COUNT; i++) {
-        voice_t* v = &m.voices[i];
+        voice_t* v = &m->voices[i];
 
         // BRR buffer
         for (int n = 0; n < SPC_BRR_BUF_SIZE; n++) {
@@ -1294,55 +1331,55 @@ void spc_dsp_copy_state(unsigned char** io, dsp_copy_func_t copy) {
     // Echo history
     for (int i = 0; i < SPC_ECHO_HIST_SIZE; i++) {
         for (int j = 0; j < 2; j++) {
-            int s = m.echo_hist_pos[i][j];
+            int s = m->echo_hist_pos[i][j];
             SPC_COPY(int16_t, s);
-            m.echo_hist[i][j] = s; // write back at offset 0
+            m->echo_hist[i][j] = s; // write back at offset 0
         }
     }
-    m.echo_hist_pos = m.echo_hist;
-    memcpy(&m.echo_hist[SPC_ECHO_HIST_SIZE], m.echo_hist, SPC_ECHO_HIST_SIZE * sizeof m.echo_hist[0]);
+    m->echo_hist_pos = m->echo_hist;
+    memcpy(&m->echo_hist[SPC_ECHO_HIST_SIZE], m->echo_hist, SPC_ECHO_HIST_SIZE * sizeof m->echo_hist[0]);
 
     // Misc
-    SPC_COPY(uint8_t, m.every_other_sample);
-    SPC_COPY(uint8_t, m.kon);
-
-    SPC_COPY(uint16_t, m.noise);
-    SPC_COPY(uint16_t, m.counter);
-    SPC_COPY(uint16_t, m.echo_offset);
-    SPC_COPY(uint16_t, m.echo_length);
-    SPC_COPY(uint8_t, m.phase);
-
-    SPC_COPY(uint8_t, m.new_kon);
-    SPC_COPY(uint8_t, m.endx_buf);
-    SPC_COPY(uint8_t, m.envx_buf);
-    SPC_COPY(uint8_t, m.outx_buf);
-
-    SPC_COPY(uint8_t, m.t_pmon);
-    SPC_COPY(uint8_t, m.t_non);
-    SPC_COPY(uint8_t, m.t_eon);
-    SPC_COPY(uint8_t, m.t_dir);
-    SPC_COPY(uint8_t, m.t_koff);
-
-    SPC_COPY(uint16_t, m.t_brr_next_addr);
-    SPC_COPY(uint8_t, m.t_adsr0);
-    SPC_COPY(uint8_t, m.t_brr_header);
-    SPC_COPY(uint8_t, m.t_brr_byte);
-    SPC_COPY(uint8_t, m.t_srcn);
-    SPC_COPY(uint8_t, m.t_esa);
-    SPC_COPY(uint8_t, m.t_echo_enabled);
-
-    SPC_COPY(int16_t, m.t_main_out[0]);
-    SPC_COPY(int16_t, m.t_main_out[1]);
-    SPC_COPY(int16_t, m.t_echo_out[0]);
-    SPC_COPY(int16_t, m.t_echo_out[1]);
-    SPC_COPY(int16_t, m.t_echo_in[0]);
-    SPC_COPY(int16_t, m.t_echo_in[1]);
-
-    SPC_COPY(uint16_t, m.t_dir_addr);
-    SPC_COPY(uint16_t, m.t_pitch);
-    SPC_COPY(int16_t, m.t_output);
-    SPC_COPY(uint16_t, m.t_echo_ptr);
-    SPC_COPY(uint8_t, m.t_looped);
+    SPC_COPY(uint8_t, m->every_other_sample);
+    SPC_COPY(uint8_t, m->kon);
+
+    SPC_COPY(uint16_t, m->noise);
+    SPC_COPY(uint16_t, m->counter);
+    SPC_COPY(uint16_t, m->echo_offset);
+    SPC_COPY(uint16_t, m->echo_length);
+    SPC_COPY(uint8_t, m->phase);
+
+    SPC_COPY(uint8_t, m->new_kon);
+    SPC_COPY(uint8_t, m->endx_buf);
+    SPC_COPY(uint8_t, m->envx_buf);
+    SPC_COPY(uint8_t, m->outx_buf);
+
+    SPC_COPY(uint8_t, m->t_pmon);
+    SPC_COPY(uint8_t, m->t_non);
+    SPC_COPY(uint8_t, m->t_eon);
+    SPC_COPY(uint8_t, m->t_dir);
+    SPC_COPY(uint8_t, m->t_koff);
+
+    SPC_COPY(uint16_t, m->t_brr_next_addr);
+    SPC_COPY(uint8_t, m->t_adsr0);
+    SPC_COPY(uint8_t, m->t_brr_header);
+    SPC_COPY(uint8_t, m->t_brr_byte);
+    SPC_COPY(uint8_t, m->t_srcn);
+    SPC_COPY(uint8_t, m->t_esa);
+    SPC_COPY(uint8_t, m->t_echo_enabled);
+
+    SPC_COPY(int16_t, m->t_main_out[0]);
+    SPC_COPY(int16_t, m->t_main_out[1]);
+    SPC_COPY(int16_t, m->t_echo_out[0]);
+    SPC_COPY(int16_t, m->t_echo_out[1]);
+    SPC_COPY(int16_t, m->t_echo_in[0]);
+    SPC_COPY(int16_t, m->t_echo_in[1]);
+
+    SPC_COPY(uint16_t, m->t_dir_addr);
+    SPC_COPY(uint16_t, m->t_pitch);
+    SPC_COPY(int16_t, m->t_output);
+    SPC_COPY(uint16_t, m->t_echo_ptr);
+    SPC_COPY(uint8_t, m->t_looped);
 
     SPC_COPY(uint8_t, extra);
 }
@@ -29,49 +29,63 @@ extern "C" {
 
 typedef void (*dsp_copy_func_t)(unsigned char**, void*, size_t);
 
+// Opaque DSP state. All state lives in this object, so multiple independent
+// DSPs may exist at the same time.
+typedef struct _spc_dsp_t spc_dsp_t;
+
 // Setup
 
+// Allocates a new DSP, returning NULL on failure
+spc_dsp_t* spc_dsp_new(void);
+
+// Frees a DSP allocated with spc_dsp_new
+void spc_dsp_delete(spc_dsp_t*);
+
 // Initializes DSP and has it use the 64K RAM provided
-void spc_dsp_init(void*);
+void spc_dsp_init(spc_dsp_t*, void*);
 
 // Sets destination for output samples. If out is NULL or out_size is 0,
 // doesn't generate any.
-void spc_dsp_set_output(int16_t*, int);
+void spc_dsp_set_output(spc_dsp_t*, int16_t*, int);
 
 // Sets the interpolation algorithm
-void spc_dsp_set_interpolation(int);
+void spc_dsp_set_interpolation(spc_dsp_t*, int);
+
+// Flags for each 256-byte page of RAM, set when echo writes to the page. The
+// caller clears them, so that it can track which pages RAM changed in.
+unsigned char* spc_dsp_echo_pages(spc_dsp_t*);
 
 // Emulation
 
 // Resets DSP to power-on state
-void spc_dsp_reset(void);
+void spc_dsp_reset(spc_dsp_t*);
 
 // Emulates pressing reset switch on SNES
-void spc_dsp_soft_reset(void);
+void spc_dsp_soft_reset(spc_dsp_t*);
 
 // Sound control
 
 // This is from byuu's snes_spc fork
-bool spc_dsp_mute(void);
+bool spc_dsp_mute(spc_dsp_t*);
 
 // Number of samples written to output since it was last set, always
 // a multiple of 2. Undefined if more samples were generated than
 // output buffer could hold.
-int spc_dsp_sample_count(void);
+int spc_dsp_sample_count(spc_dsp_t*);
 
 // Reads/writes DSP registers. For accuracy, you must first call run()
 // to catch the DSP up to present.
-int  spc_dsp_read(int);
-void spc_dsp_write(int, int);
+int  spc_dsp_read(spc_dsp_t*, int);
+void spc_dsp_write(spc_dsp_t*, int, int);
 
 // Runs DSP for specified number of clocks (~1024000 per second). Every 32 clocks
 // a pair of samples is be generated.
-void spc_dsp_run(int);
+void spc_dsp_run(spc_dsp_t*, int);
 
 // State
 
 // Saves/loads exact emulator state
-void spc_dsp_copy_state(unsigned char**, dsp_copy_func_t);
+void spc_dsp_copy_state(spc_dsp_t*, unsigned char**, dsp_copy_func_t);
 
 #ifdef __cplusplus
 }
@@ -172,6 +172,18 @@ static jg_setting_t settings_bsnes[] = {
       "Enable hotfixes for games that were released with fundamental bugs",
       0, 0, 1, JG_SETTING_RESTART
     },
+    { "fast_ppu", "Fast PPU",
+      "0 = Off, 1 = On",
+      "Render whole scanlines at once for a performance increase at the cost "
+      "of accuracy in games which change PPU registers mid-scanline",
+      0, 0, 1, 0
+    },
+    { "render_threads", "Render Threads",
+      "N = Number of threads, 0 = Off",
+      "Composite scanlines on N additional threads to take work off the main "
+      "emulation thread",
+      0, 0, 8, 0
+    },
     { "runahead", "Run-Ahead (Input Latency Reduction)",
       "N = Number of frames to run ahead",
       "Run N frames ahead to decrease input latency (heavy CPU load)",
@@ -202,6 +214,8 @@ enum {
     RSQUAL,
     SPC_INTERP,
     HOTFIXES,
+    FAST_PPU,
+    RENDER_THREADS,
     RUNAHEAD,
     CMPTN_TIMER
 };
@@ -729,6 +743,8 @@ int jg_init(void) {
     Bsnes::setCoprocDelayedSync(settings_bsnes[COPROC_DELAYSYNC].val);
     Bsnes::setCoprocPreferHLE(settings_bsnes[COPROC_PREFERHLE].val);
     Bsnes::setHotfixes(settings_bsnes[HOTFIXES].val);
+    Bsnes::setFastPPU(settings_bsnes[FAST_PPU].val);
+    Bsnes::setRenderThreads(settings_bsnes[RENDER_THREADS].val);
     Bsnes::setVideoColourParams(settings_bsnes[LUMINANCE].val * 10,
         settings_bsnes[SATURATION].val * 10,
         settings_bsnes[GAMMA].val * 10 + 100);
@@ -916,6 +932,8 @@ void jg_rehash(void) {
         settings_bsnes[SATURATION].val * 10,
         settings_bsnes[GAMMA].val * 10 + 100);
     Bsnes::setSpcInterpolation(settings_bsnes[SPC_INTERP].val);
+    Bsnes::setFastPPU(settings_bsnes[FAST_PPU].val);
+    Bsnes::setRenderThreads(settings_bsnes[RENDER_THREADS].val);
 }
 
 void jg_data_push(uint32_t, int, const void*, size_t) {
@@ -943,13 +961,15 @@ jg_setting_t* jg_get_settings(size_t *numsettings) {
 }
 
 void jg_setup_video(void) {
-    Bsnes::setVideoSpec({(uint32_t*)vidinfo.buf, nullptr, &videoFrame});
+    Bsnes::setVideoSpec({vidinfo.buf, nullptr, &videoFrame,
+        Bsnes::Video::PixelFormat::XRGB8888});
 }
 
 void jg_setup_audio(void) {
     Bsnes::setAudioSpec({double(SAMPLERATE), audinfo.spf,
         unsigned(settings_bsnes[RSQUAL].val),
-        (float*)audinfo.buf, nullptr, &audioFrame});
+        (float*)audinfo.buf, nullptr, &audioFrame,
+        Bsnes::Audio::Mode::Resampled, nullptr});
 }
 
 void jg_set_inputstate(jg_inputstate_t *ptr, int port) {
@@ -0,0 +1,375 @@
+/*
+Copyright (c) 2024 Rupert Carmichael
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+
+#include <sys/resource.h>
+
+#include <bsnes.hpp>
+
+#define SAMPLERATE 48000
+#define FRAMERATE 60 // Approximately 60Hz
+
+// Buffers which the emulator renders into, never presented
+static uint32_t vbuf[512 * 480];
+static float abuf[(SAMPLERATE / FRAMERATE) << 2];
+
+// Game related
+static std::vector<uint8_t> game;
+static std::string gamepath = "";
+
+// Data path for BML assets
+static std::string datapath = "";
+
+struct Result {
+    std::string path;
+    bool loaded;
+    unsigned frames;
+    double seconds;
+    double fps;
+    double min;     // Frame times in milliseconds
+    double median;
+    double p99;
+    double switches; // Mean context switches per frame
+    long rss;       // Peak resident set size in kilobytes
+};
+
+static void logCallback(void*, int level, std::string& text) {
+    if (level > 1)
+        fprintf(stderr, "%s\n", text.c_str());
+}
+
+static bool fileOpenS(void*, std::string name, std::stringstream& ss) {
+    std::string path = datapath + "/" + name;
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+
+    if (!stream.is_open()) {
+        fprintf(stderr, "Failed to load file: %s\n", path.c_str());
+        return false;
+    }
+
+    ss << stream.rdbuf();
+    stream.close();
+
+    return true;
+}
+
+// Saves are neither loaded nor written so every run starts from the same state
+static bool fileOpenV(void*, std::string, std::vector<uint8_t>&) {
+    return false;
+}
+
+static bool fileOpenMsu(void*, std::string, std::istream**) {
+    return false;
+}
+
+static void fileWrite(void*, std::string, const uint8_t*, unsigned) {
+}
+
+static bool loadRom(void*, unsigned id) {
+    if (id == Bsnes::GameType::SuperFamicom) {
+        if (game.size() < 0x8000) return false;
+        Bsnes::setRomSuperFamicom(game, gamepath);
+        return true;
+    }
+    return false;
+}
+
+static void videoFrame(const void*, unsigned, unsigned, unsigned) {
+}
+
+static void audioFrame(const void*, size_t) {
+}
+
+static void audioFrameNative(const void*, const int16_t*, size_t) {
+}
+
+static bool pullaudio = false;
+
+// Run one frame, then drain audio as a host audio thread would if pulling
+static void runFrame() {
+    Bsnes::run();
+
+    if (pullaudio) {
+        while (Bsnes::Audio::read(abuf, SAMPLERATE / FRAMERATE)) { }
+    }
+}
+
+static int pollGamepad(const void*, unsigned, unsigned) {
+    return 0;
+}
+
+static long peakRss() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024; // bytes
+#else
+    return usage.ru_maxrss; // kilobytes
+#endif
+}
+
+static double percentile(std::vector<double>& v, double p) {
+    size_t index = (size_t)(p * (v.size() - 1) + 0.5);
+    return v[index];
+}
+
+static Result runGame(std::string path, unsigned frames, unsigned warmup) {
+    Result result = {path, false, 0, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+    if (!stream.is_open()) {
+        fprintf(stderr, "Failed to open %s\n", path.c_str());
+        return result;
+    }
+
+    game = std::vector<uint8_t>((std::istreambuf_iterator<char>(stream)),
+        std::istreambuf_iterator<char>());
+    stream.close();
+    gamepath = path;
+
+    if (!Bsnes::load()) {
+        fprintf(stderr, "Failed to load ROM: %s\n", path.c_str());
+        return result;
+    }
+
+    Bsnes::power();
+
+    Bsnes::setInputSpec({0, Bsnes::Input::Device::Gamepad,
+        nullptr, pollGamepad});
+    Bsnes::setInputSpec({1, Bsnes::Input::Device::Gamepad,
+        nullptr, pollGamepad});
+
+    for (unsigned i = 0; i < warmup; ++i)
+        runFrame();
+
+    std::vector<double> times;
+    times.reserve(frames);
+    unsigned long long switches = 0;
+
+    auto begin = std::chrono::steady_clock::now();
+    for (unsigned i = 0; i < frames; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        runFrame();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(
+            std::chrono::duration<double, std::milli>(end - start).count());
+        switches += Bsnes::getContextSwitches();
+    }
+    auto finish = std::chrono::steady_clock::now();
+
+    Bsnes::unload();
+
+    result.loaded = true;
+    result.frames = frames;
+    result.seconds = std::chrono::duration<double>(finish - begin).count();
+    result.fps = result.seconds > 0.0 ? frames / result.seconds : 0.0;
+    result.switches = (double)switches / frames;
+
+    if (!times.empty()) {
+        std::sort(times.begin(), times.end());
+        result.min = times.front();
+        result.median = percentile(times, 0.50);
+        result.p99 = percentile(times, 0.99);
+    }
+
+    result.rss = peakRss();
+
+    return result;
+}
+
+static std::string jsonEscape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\')
+            out += '\\';
+        if ((unsigned char)c < 0x20)
+            continue;
+        out += c;
+    }
+    return out;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s [-n FRAMES] [-w WARMUP] [-f] [-t THREADS] [-p FORMAT] [-s FRAMES] [-a] [-r] [-j] FILE...\n"
+        "  -n FRAMES  Number of frames to measure (default 3000)\n"
+        "  -w WARMUP  Number of frames to run before measuring (default 60)\n"
+        "  -f         Use the fast (scanline) PPU renderer\n"
+        "  -t THREADS Number of render threads (default 0)\n"
+        "  -p FORMAT  Pixel format: xrgb8888 (default), xrgb1555 or rgb565\n"
+        "  -s FRAMES  Frames to skip drawing after each one drawn (default 0)\n"
+        "  -a         Read audio with Bsnes::Audio::read instead of a callback\n"
+        "  -r         Output native rate audio without resampling\n"
+        "  -j         Output results as JSON\n", name);
+}
+
+int main (int argc, char *argv[]) {
+    unsigned frames = 3000;
+    unsigned warmup = 60;
+    bool json = false;
+    bool fastppu = false;
+    unsigned threads = 0;
+    unsigned pixfmt = Bsnes::Video::PixelFormat::XRGB8888;
+    unsigned frameskip = 0;
+    unsigned audiomode = Bsnes::Audio::Mode::Resampled;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            frames = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-w") && i + 1 < argc) {
+            warmup = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-f")) {
+            fastppu = true;
+        }
+        else if (!strcmp(argv[i], "-t") && i + 1 < argc) {
+            threads = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "xrgb8888") {
+                pixfmt = Bsnes::Video::PixelFormat::XRGB8888;
+            }
+            else if (format == "xrgb1555") {
+                pixfmt = Bsnes::Video::PixelFormat::XRGB1555;
+            }
+            else if (format == "rgb565") {
+                pixfmt = Bsnes::Video::PixelFormat::RGB565;
+            }
+            else {
+                usage(argv[0]);
+                return 1;
+            }
+        }
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+            frameskip = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "-a")) {
+            pullaudio = true;
+        }
+        else if (!strcmp(argv[i], "-r")) {
+            audiomode = Bsnes::Audio::Mode::Native;
+        }
+        else if (!strcmp(argv[i], "-j")) {
+            json = true;
+        }
+        else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        }
+        else {
+            paths.push_back(argv[i]);
+        }
+    }
+
+    if (paths.empty() || !frames) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // Find the relative path to the executable
+    std::string relpath = argv[0];
+    relpath = relpath.substr(0, relpath.find_last_of('/'));
+
+    // Set data path for BML assets
+    std::ifstream bmlstream(relpath + "/boards.bml");
+    if (bmlstream.is_open()) {
+        datapath = relpath;
+    }
+    else {
+        datapath = DATADIR;
+        bmlstream = std::ifstream(datapath + "/boards.bml");
+    }
+
+    if (bmlstream.is_open()) {
+        bmlstream.close();
+    }
+    else {
+        fprintf(stderr, "Failed to deduce BML asset location\n");
+        return 1;
+    }
+
+    // Fixed settings so that runs are reproducible
+    Bsnes::setOpenFileCallback(nullptr, fileOpenV);
+    Bsnes::setOpenStreamCallback(nullptr, fileOpenS);
+    Bsnes::setOpenMsuCallback(nullptr, fileOpenMsu);
+    Bsnes::setRomLoadCallback(nullptr, loadRom);
+    Bsnes::setWriteCallback(nullptr, fileWrite);
+    Bsnes::setLogCallback(nullptr, logCallback);
+
+    Bsnes::setAudioSpec({double(SAMPLERATE), (SAMPLERATE / FRAMERATE) << 1, 0,
+        abuf, nullptr, pullaudio ? nullptr : &audioFrame, audiomode,
+        &audioFrameNative});
+    Bsnes::setVideoSpec({vbuf, nullptr, &videoFrame, pixfmt});
+
+    Bsnes::setEntropy(Bsnes::Entropy::None);
+    Bsnes::setCoprocDelayedSync(true);
+    Bsnes::setCoprocPreferHLE(false);
+    Bsnes::setHotfixes(false);
+    Bsnes::setFastPPU(fastppu);
+    Bsnes::setRenderThreads(threads);
+    Bsnes::setFrameSkip(frameskip);
+    Bsnes::setSpcInterpolation(Bsnes::Audio::Interpolation::Gaussian);
+    Bsnes::setVideoColourParams(100, 100, 120);
+
+    std::vector<Result> results;
+    for (std::string& path : paths)
+        results.push_back(runGame(path, frames, warmup));
+
+    if (json) {
+        printf("[\n");
+        for (size_t i = 0; i < results.size(); ++i) {
+            Result& r = results[i];
+            printf("  {\"rom\": \"%s\", \"loaded\": %s, \"frames\": %u, "
+                "\"seconds\": %.6f, \"fps\": %.3f, \"frame_ms\": "
+                "{\"min\": %.6f, \"median\": %.6f, \"p99\": %.6f}, "
+                "\"switches_per_frame\": %.1f, \"peak_rss_kb\": %ld}%s\n",
+                jsonEscape(r.path).c_str(), r.loaded ? "true" : "false",
+                r.frames, r.seconds, r.fps, r.min, r.median, r.p99,
+                r.switches, r.rss,
+                i + 1 < results.size() ? "," : "");
+        }
+        printf("]\n");
+    }
+    else {
+        for (Result& r : results) {
+            if (!r.loaded) {
+                printf("%s: failed to load\n", r.path.c_str());
+                continue;
+            }
+            printf("%s\n"
+                "  %u frames in %.3fs (%.2f fps)\n"
+                "  frame time (ms): min %.3f, median %.3f, p99 %.3f\n"
+                "  context switches per frame: %.1f\n"
+                "  peak RSS: %ld KiB\n",
+                r.path.c_str(), r.frames, r.seconds, r.fps,
+                r.min, r.median, r.p99, r.switches, r.rss);
+        }
+    }
+
+    for (Result& r : results) {
+        if (!r.loaded)
+            return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,162 @@
+/*
+Copyright (c) 2024 Rupert Carmichael
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../../src/colormath.hpp"
+
+using namespace SuperFamicom;
+
+// One hires scanline, as composited by the scanline renderer
+#define WIDTH 512
+
+static uint16_t x[WIDTH], y[WIDTH], halve[WIDTH];
+static uint16_t out[WIDTH], ref[WIDTH];
+
+// Reference brightness, as the removed per-level table computed it
+static unsigned refBrightness(unsigned color, unsigned level) {
+    double luma = (double)level / 15.0;
+    unsigned r = luma * (color >>  0 & 31) + 0.5;
+    unsigned g = luma * (color >>  5 & 31) + 0.5;
+    unsigned b = luma * (color >> 10 & 31) + 0.5;
+    return b << 10 | g << 5 | r << 0;
+}
+
+static bool verify() {
+    // Every color at every level
+    for (unsigned level = 0; level < 16; ++level) {
+        for (unsigned color = 0; color < 32768; color += WIDTH) {
+            for (unsigned i = 0; i < WIDTH; ++i)
+                x[i] = color + i;
+
+            ColorMath::brightness(out, x, WIDTH, level);
+
+            for (unsigned i = 0; i < WIDTH; ++i) {
+                if (out[i] != refBrightness(x[i], level)) {
+                    fprintf(stderr, "brightness(%04x, %u): %04x != %04x\n",
+                        x[i], level, out[i], refBrightness(x[i], level));
+                    return false;
+                }
+            }
+        }
+    }
+
+    // Random operands in both modes, odd counts to cover the scalar tail
+    srand(1);
+    for (unsigned pass = 0; pass < 4096; ++pass) {
+        bool subtract = pass & 1;
+        unsigned count = WIDTH - (pass % 7);
+
+        for (unsigned i = 0; i < WIDTH; ++i) {
+            x[i] = rand() & 0x7fff;
+            y[i] = rand() & 0x7fff;
+            halve[i] = rand() & 1 ? 0xffff : 0;
+        }
+
+        ColorMath::blend(out, x, y, halve, count, subtract);
+
+        for (unsigned i = 0; i < count; ++i) {
+            unsigned expect = ColorMath::blend(x[i], y[i], subtract, halve[i]);
+            if (out[i] != expect) {
+                fprintf(stderr, "blend(%04x, %04x, %u, %u): %04x != %04x\n",
+                    x[i], y[i], subtract, halve[i] & 1, out[i], expect);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+template<typename F>
+static double measure(unsigned lines, F func) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned i = 0; i < lines; ++i)
+        func();
+
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    return elapsed.count() / ((double)lines * WIDTH);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-n LINES]\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned lines = 1000000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            lines = atoi(argv[++i]);
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!verify()) {
+        fprintf(stderr, "Vector and scalar results differ\n");
+        return 1;
+    }
+
+    for (unsigned i = 0; i < WIDTH; ++i) {
+        x[i] = rand() & 0x7fff;
+        y[i] = rand() & 0x7fff;
+        halve[i] = rand() & 1 ? 0xffff : 0;
+    }
+
+    double vadd = measure(lines, [] {
+        ColorMath::blend(out, x, y, halve, WIDTH, false);
+        x[0] = out[WIDTH - 1]; // Keep the stores live
+    });
+    double vsub = measure(lines, [] {
+        ColorMath::blend(out, x, y, halve, WIDTH, true);
+        x[0] = out[WIDTH - 1];
+    });
+    double vlight = measure(lines, [] {
+        ColorMath::brightness(out, x, WIDTH, 9);
+        x[0] = out[WIDTH - 1];
+    });
+
+    double sadd = measure(lines, [] {
+        for (unsigned i = 0; i < WIDTH; ++i)
+            ref[i] = ColorMath::blend(x[i], y[i], false, halve[i]);
+        x[0] = ref[WIDTH - 1];
+    });
+    double ssub = measure(lines, [] {
+        for (unsigned i = 0; i < WIDTH; ++i)
+            ref[i] = ColorMath::blend(x[i], y[i], true, halve[i]);
+        x[0] = ref[WIDTH - 1];
+    });
+    double slight = measure(lines, [] {
+        for (unsigned i = 0; i < WIDTH; ++i)
+            ref[i] = ColorMath::brightness(x[i], 9);
+        x[0] = ref[WIDTH - 1];
+    });
+
+    printf("%u lines of %u pixels, ns/pixel (line / per pixel):\n",
+        lines, WIDTH);
+    printf("  add:        %.3f / %.3f\n", vadd, sadd);
+    printf("  subtract:   %.3f / %.3f\n", vsub, ssub);
+    printf("  brightness: %.3f / %.3f\n", vlight, slight);
+
+    return 0;
+}
@@ -0,0 +1,207 @@
+/*
+Copyright (c) 2024 Rupert Carmichael
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#include "../../src/function.hpp"
+
+// The previous bfunction, which allocated a container per binding and called
+// through a virtual operator()
+template<typename T> struct oldfunction;
+
+template<typename R, typename... P> struct oldfunction<R (P...)> {
+  template<typename L> struct is_compatible {
+    template<typename T> static const typename std::is_same<R, decltype(std::declval<T>().operator()(std::declval<P>()...))>::type exists(T*);
+    static constexpr bool value = decltype(exists<L>(0))::value;
+  };
+
+  oldfunction() {}
+  template<typename C> oldfunction(R (C::*_bfunction)(P...), C* object) { callback = new member<C>(_bfunction, object); }
+  template<typename L, typename = typename std::enable_if<is_compatible<L>::value>::type> oldfunction(const L& object) { callback = new lambda<L>(object); }
+  ~oldfunction() { if(callback) delete callback; }
+
+  explicit operator bool() const { return callback; }
+  R operator()(P... p) const { return (*callback)(std::forward<P>(p)...); }
+  void reset() { if(callback) { delete callback; callback = nullptr; } }
+
+  oldfunction& operator=(const oldfunction& source) {
+    if(this != &source) {
+      if(callback) { delete callback; callback = nullptr; }
+      if(source.callback) callback = source.callback->copy();
+    }
+    return *this;
+  }
+
+private:
+  struct container {
+    virtual R operator()(P... p) const = 0;
+    virtual container* copy() const = 0;
+    virtual ~container() = default;
+  };
+
+  container* callback = nullptr;
+
+  template<typename C> struct member : container {
+    R (C::*bfunction)(P...);
+    C* object;
+    R operator()(P... p) const { return (object->*bfunction)(std::forward<P>(p)...); }
+    container* copy() const { return new member(bfunction, object); }
+    member(R (C::*_bfunction)(P...), C* obj) : bfunction(_bfunction), object(obj) {}
+  };
+
+  template<typename L> struct lambda : container {
+    mutable L object;
+    R operator()(P... p) const { return object(std::forward<P>(p)...); }
+    container* copy() const { return new lambda(object); }
+    lambda(const L& obj) : object(obj) {}
+  };
+};
+
+// A bus reader table, as Bus::map fills it
+#define HANDLERS 256
+#define ACCESSES 4096
+
+struct Chip {
+    uint8_t memory[256];
+    uint8_t read(unsigned address, uint8_t) { return memory[address & 255]; }
+};
+
+static Chip chips[4];
+static unsigned addresses[ACCESSES];
+
+static uint8_t openbus(unsigned address, uint8_t data) {
+    return data ^ address;
+}
+
+template<typename F> struct Table {
+    F reader[HANDLERS];
+
+    void mapMembers() {
+        for (unsigned i = 0; i < HANDLERS; ++i)
+            reader[i] = F(&Chip::read, &chips[i & 3]);
+    }
+
+    void mapFunctions() {
+        for (unsigned i = 0; i < HANDLERS; ++i)
+            reader[i] = [](unsigned address, uint8_t data) -> uint8_t {
+                return openbus(address, data);
+            };
+    }
+
+    unsigned run() const {
+        unsigned sum = 0;
+        uint8_t data = 0;
+        for (unsigned i = 0; i < ACCESSES; ++i) {
+            unsigned address = addresses[i];
+            data = reader[address >> 16 & 255](address, data);
+            sum += data;
+        }
+        return sum;
+    }
+};
+
+static Table<bfunction<uint8_t (unsigned, uint8_t)>> current;
+static Table<oldfunction<uint8_t (unsigned, uint8_t)>> previous;
+
+static bool verify() {
+    current.mapMembers();
+    previous.mapMembers();
+    if (current.run() != previous.run()) {
+        fprintf(stderr, "member: %u != %u\n", current.run(), previous.run());
+        return false;
+    }
+
+    current.mapFunctions();
+    previous.mapFunctions();
+    if (current.run() != previous.run()) {
+        fprintf(stderr, "function: %u != %u\n", current.run(), previous.run());
+        return false;
+    }
+
+    return true;
+}
+
+template<typename F>
+static double measure(unsigned passes, unsigned count, F func) {
+    auto start = std::chrono::steady_clock::now();
+
+    for (unsigned i = 0; i < passes; ++i)
+        func();
+
+    auto end = std::chrono::steady_clock::now();
+    std::chrono::duration<double, std::nano> elapsed = end - start;
+    return elapsed.count() / ((double)passes * count);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-n PASSES]\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned passes = 100000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            passes = atoi(argv[++i]);
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    srand(1);
+    for (unsigned i = 0; i < 4; ++i)
+        for (unsigned j = 0; j < 256; ++j)
+            chips[i].memory[j] = rand();
+    for (unsigned i = 0; i < ACCESSES; ++i)
+        addresses[i] = rand() & 0xffffff;
+
+    if (!verify()) {
+        fprintf(stderr, "Inline and heap delegates differ\n");
+        return 1;
+    }
+
+    volatile unsigned sink = 0; // Keep the calls live
+
+    double nmapm = measure(passes, HANDLERS, [] { current.mapMembers(); });
+    double nmapf = measure(passes, HANDLERS, [] { current.mapFunctions(); });
+    double omapm = measure(passes, HANDLERS, [] { previous.mapMembers(); });
+    double omapf = measure(passes, HANDLERS, [] { previous.mapFunctions(); });
+
+    current.mapMembers();
+    previous.mapMembers();
+    double ncallm = measure(passes, ACCESSES, [&] { sink = sink + current.run(); });
+    double ocallm = measure(passes, ACCESSES, [&] { sink = sink + previous.run(); });
+
+    current.mapFunctions();
+    previous.mapFunctions();
+    double ncallf = measure(passes, ACCESSES, [&] { sink = sink + current.run(); });
+    double ocallf = measure(passes, ACCESSES, [&] { sink = sink + previous.run(); });
+
+    printf("%u passes over %u handlers and %u accesses, ns (inline / heap):\n",
+        passes, HANDLERS, ACCESSES);
+    printf("  bind member:   %.3f / %.3f\n", nmapm, omapm);
+    printf("  bind function: %.3f / %.3f\n", nmapf, omapf);
+    printf("  call member:   %.3f / %.3f\n", ncallm, ocallm);
+    printf("  call function: %.3f / %.3f\n", ncallf, ocallf);
+
+    return 0;
+}
@@ -0,0 +1,249 @@
+/*
+Copyright (c) 2024 Rupert Carmichael
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Built in directly for its internals and to run it on a synthetic setup
+#include "../../deps/snes_spc/spc_dsp.c"
+
+/* The DSP evaluates the echo FIR a few taps at a time over four clocks, each
+ * tap reading its coefficient on the clock the hardware does. A vector version
+ * has to gather the coefficients and evaluate all eight taps for both channels
+ * at once on the last of those clocks. That is bit-exact, but when measured in
+ * place it was slower than the scalar taps, which overlap with the voice work
+ * on the same clocks. The vector kernel is kept here so that it can be checked
+ * and measured again on other hardware.
+ */
+
+// History (oldest first, L/R pairs) and coefficients for taps 0-7
+static int16_t hist[SPC_ECHO_HIST_SIZE * 2][2];
+static int8_t coef[8];
+
+// The DSP's FIR: seven taps summed, wrapped to 16 bits, then the last added
+static void scalarFir(int16_t (*h)[2], int8_t const* c, int out[2]) {
+    for (int ch = 0; ch < 2; ++ch) {
+        int s = 0;
+        for (int i = 0; i < 7; ++i)
+            s += (h[i][ch] * c[i]) >> 6;
+        s = (int16_t)s;
+        s += (int16_t)((h[7][ch] * c[7]) >> 6);
+        CLAMP16(s);
+        out[ch] = s & ~1;
+    }
+}
+
+static void vectorFir(int16_t (*h)[2], int8_t const* c, int out[2]) {
+#if defined(SPC_SSE2)
+    // L/R pairs for taps 0-3 and 4-7, coefficients doubled to match
+    __m128i h0 = _mm_loadu_si128((__m128i const*)h[0]);
+    __m128i h1 = _mm_loadu_si128((__m128i const*)h[4]);
+    __m128i cv = _mm_loadl_epi64((__m128i const*)c);
+    cv = _mm_srai_epi16(_mm_unpacklo_epi8(cv, cv), 8);
+    __m128i c0 = _mm_unpacklo_epi16(cv, cv);
+    __m128i c1 = _mm_unpackhi_epi16(cv, cv);
+
+    // Full 32-bit products from the low and high halves
+    __m128i lo0 = _mm_mullo_epi16(h0, c0), hi0 = _mm_mulhi_epi16(h0, c0);
+    __m128i lo1 = _mm_mullo_epi16(h1, c1), hi1 = _mm_mulhi_epi16(h1, c1);
+    __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo0, hi0), 6);
+    __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo0, hi0), 6);
+    __m128i p2 = _mm_srai_epi32(_mm_unpacklo_epi16(lo1, hi1), 6);
+    __m128i p3 = _mm_srai_epi32(_mm_unpackhi_epi16(lo1, hi1), 6);
+
+    __m128i sum = _mm_add_epi32(_mm_add_epi32(p0, p1),
+        _mm_add_epi32(p2, _mm_move_epi64(p3)));
+    sum = _mm_add_epi32(sum, _mm_srli_si128(sum, 8));
+    sum = _mm_srai_epi32(_mm_slli_epi32(sum, 16), 16);
+
+    __m128i last = _mm_srli_si128(p3, 8);
+    last = _mm_srai_epi32(_mm_slli_epi32(last, 16), 16);
+
+    // CLAMP16 is a saturating pack
+    __m128i v = _mm_packs_epi32(_mm_add_epi32(sum, last), sum);
+    out[0] = (int16_t)_mm_extract_epi16(v, 0) & ~1;
+    out[1] = (int16_t)_mm_extract_epi16(v, 1) & ~1;
+#elif defined(__ARM_NEON)
+    int16x8_t h0 = vld1q_s16(h[0]);
+    int16x8_t h1 = vld1q_s16(h[4]);
+    int16x8_t c8 = vmovl_s8(vld1_s8(c));
+    int16x8x2_t cv = vzipq_s16(c8, c8);
+
+    int32x4_t p0 = vshrq_n_s32(vmull_s16(vget_low_s16(h0), vget_low_s16(cv.val[0])), 6);
+    int32x4_t p1 = vshrq_n_s32(vmull_s16(vget_high_s16(h0), vget_high_s16(cv.val[0])), 6);
+    int32x4_t p2 = vshrq_n_s32(vmull_s16(vget_low_s16(h1), vget_low_s16(cv.val[1])), 6);
+    int32x4_t p3 = vshrq_n_s32(vmull_s16(vget_high_s16(h1), vget_high_s16(cv.val[1])), 6);
+
+    int32x4_t sum4 = vaddq_s32(vaddq_s32(p0, p1), p2);
+    int32x2_t sum = vadd_s32(vadd_s32(vget_low_s32(sum4), vget_high_s32(sum4)),
+        vget_low_s32(p3));
+    sum = vshr_n_s32(vshl_n_s32(sum, 16), 16);
+    int32x2_t last = vshr_n_s32(vshl_n_s32(vget_high_s32(p3), 16), 16);
+
+    // CLAMP16 is a saturating narrow
+    int16x4_t v = vqmovn_s32(vcombine_s32(vadd_s32(sum, last), sum));
+    out[0] = vget_lane_s16(v, 0) & ~1;
+    out[1] = vget_lane_s16(v, 1) & ~1;
+#else
+    scalarFir(h, c, out);
+#endif
+}
+
+static int verify(void) {
+    srand(1);
+
+    // Random history and coefficients, with the extremes forced now and then
+    for (unsigned pass = 0; pass < 1000000; ++pass) {
+        for (int i = 0; i < 8; ++i) {
+            for (int ch = 0; ch < 2; ++ch) {
+                int s = (int16_t)(rand() & 0xFFFF) >> 1; // as echo_read stores
+                if (pass % 16 == 1) s = -0x4000;
+                if (pass % 16 == 2) s = 0x3FFF;
+                hist[i][ch] = s;
+            }
+            coef[i] = rand() & 0xFF;
+            if (pass % 16 == 1) coef[i] = -0x80;
+            if (pass % 16 == 2) coef[i] = (i & 1) ? -0x80 : 0x7F;
+        }
+
+        int out[2], expect[2];
+        vectorFir(hist, coef, out);
+        scalarFir(hist, coef, expect);
+        if (out[0] != expect[0] || out[1] != expect[1]) {
+            fprintf(stderr, "echo FIR: %d,%d != %d,%d\n",
+                out[0], out[1], expect[0], expect[1]);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+// Echo on every voice, playing random BRR data from random ARAM
+static uint8_t aram[0x10000];
+
+static void setup(spc_dsp_t* m) {
+    for (unsigned i = 0; i < sizeof aram; ++i)
+        aram[i] = rand() & 0xFF;
+
+    spc_dsp_init(m, aram);
+    spc_dsp_reset(m);
+    spc_dsp_set_output(m, NULL, 0);
+
+    static const uint8_t fir[8] = { 0x0C, 0x21, 0x2B, 0x2B, 0x13, 0xFE, 0xF3, 0xF9 };
+    for (int i = 0; i < 8; ++i)
+        spc_dsp_write(m, r_fir + i * 0x10, fir[i]);
+
+    for (int v = 0; v < SPC_VOICE_COUNT; ++v) {
+        spc_dsp_write(m, v * 0x10 + v_voll, 0x40);
+        spc_dsp_write(m, v * 0x10 + v_volr, 0x40);
+        spc_dsp_write(m, v * 0x10 + v_pitchl, 0x00);
+        spc_dsp_write(m, v * 0x10 + v_pitchh, 0x08 + v);
+        spc_dsp_write(m, v * 0x10 + v_srcn, v);
+        spc_dsp_write(m, v * 0x10 + v_adsr0, 0x8F);
+        spc_dsp_write(m, v * 0x10 + v_adsr1, 0xE0);
+    }
+
+    spc_dsp_write(m, r_mvoll, 0x7F);
+    spc_dsp_write(m, r_mvolr, 0x7F);
+    spc_dsp_write(m, r_evoll, 0x40);
+    spc_dsp_write(m, r_evolr, 0x40);
+    spc_dsp_write(m, r_efb, 0x50);
+    spc_dsp_write(m, r_eon, 0xFF);
+    spc_dsp_write(m, r_dir, 0x02);
+    spc_dsp_write(m, r_esa, 0x80);
+    spc_dsp_write(m, r_edl, 0x04);
+    spc_dsp_write(m, r_flg, 0x00);
+    spc_dsp_write(m, r_kon, 0xFF);
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// Best time per sample over short runs, so that preemption does not count
+static double measureDsp(spc_dsp_t* m, unsigned samples) {
+    double best = 1e30;
+    for (unsigned done = 0; done < samples; done += 1000) {
+        double start = now();
+        for (unsigned i = 0; i < 1000; ++i)
+            spc_dsp_run(m, 32);
+        double t = now() - start;
+        if (t < best)
+            best = t;
+    }
+    return best / 1000;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-n SAMPLES]\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned samples = 10000000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            samples = strtoul(argv[++i], NULL, 10);
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!verify()) {
+        fprintf(stderr, "Vector and scalar results differ\n");
+        return 1;
+    }
+
+    // The kernels on their own, sliding along the history as the DSP does
+    volatile int sink = 0; // Keep the results live
+    int out[2];
+
+    double start = now();
+    for (unsigned i = 0; i < samples; ++i) {
+        vectorFir(&hist[i & 7], coef, out);
+        hist[i & 7][0] = hist[(i & 7) + 8][0] = out[0] >> 1;
+        sink += out[1];
+    }
+    double vfir = (now() - start) / samples;
+
+    start = now();
+    for (unsigned i = 0; i < samples; ++i) {
+        scalarFir(&hist[i & 7], coef, out);
+        hist[i & 7][0] = hist[(i & 7) + 8][0] = out[0] >> 1;
+        sink += out[1];
+    }
+    double sfir = (now() - start) / samples;
+
+    // The whole DSP on the synthetic setup, for scale
+    spc_dsp_t* m = spc_dsp_new();
+    setup(m);
+    double full = measureDsp(m, samples);
+    spc_dsp_delete(m);
+
+    printf("%u samples, ns/sample:\n", samples);
+    printf("  echo FIR (vector / scalar): %.3f / %.3f\n", vfir, sfir);
+    printf("  DSP with echo on all voices: %.3f\n", full);
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+/*
+Copyright (c) 2024 Rupert Carmichael
+
+Permission to use, copy, modify, and/or distribute this software for any
+purpose with or without fee is hereby granted.
+
+THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#define _POSIX_C_SOURCE 199309L // clock_gettime
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// The interpolation kernels are internal to the DSP, so build it in directly
+#include "../../deps/snes_spc/spc_dsp.c"
+
+static spc_dsp_t dsp;
+static voice_t voice;
+
+// Reference sinc interpolation, as the scalar path computes it
+static int refSinc(voice_t const* v) {
+    int16_t const* in = &v->buf[(v->interp_pos >> 12) + v->buf_pos];
+    short const* filt = sinc + ((v->interp_pos & 0xFF0) >> 1);
+    int out = 0;
+
+    for (int i = 0; i < 8; ++i)
+        out += filt[i] * in[i];
+    out >>= 14;
+
+    CLAMP16(out);
+    return out;
+}
+
+static void fill(int pattern) {
+    for (int i = 0; i < SPC_BRR_BUF_SIZE * 2; ++i) {
+        if (pattern == 0)
+            voice.buf[i] = (int16_t)(rand() & 0xFFFF);
+        else if (pattern == 1)
+            voice.buf[i] = 32767;
+        else if (pattern == 2)
+            voice.buf[i] = -32768;
+        else // Alternate extremes to push the sum as far as it can go
+            voice.buf[i] = (i & 1) ? 32767 : -32768;
+    }
+}
+
+static int verify(void) {
+    dsp.interp_algo = 1;
+    srand(1);
+
+    // Every position at every buffer offset, for random and extreme samples
+    for (int pass = 0; pass < 64; ++pass) {
+        fill(pass < 60 ? 0 : pass - 60);
+        for (int pos = 0; pos < SPC_BRR_BUF_SIZE; pos += 4) {
+            voice.buf_pos = pos;
+            for (int ip = 0; ip < 0x8000; ++ip) {
+                voice.interp_pos = ip;
+                int out = interpolate(&dsp, &voice);
+                int expect = refSinc(&voice);
+                if (out != expect) {
+                    fprintf(stderr, "sinc(pos %d, interp_pos %04x): %d != %d\n",
+                        pos, ip, out, expect);
+                    return 0;
+                }
+            }
+        }
+    }
+
+    return 1;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-n SAMPLES]\n", argv0);
+}
+
+int main(int argc, char *argv[]) {
+    unsigned samples = 100000000;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            samples = strtoul(argv[++i], NULL, 10);
+        }
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (!verify()) {
+        fprintf(stderr, "Vector and scalar results differ\n");
+        return 1;
+    }
+
+    fill(0);
+    voice.buf_pos = 4;
+    volatile int sink = 0; // Keep the results live
+
+    double start = now();
+    for (unsigned i = 0; i < samples; ++i) {
+        voice.interp_pos = (i * 0x3A7) & 0x7FFF;
+        sink += interpolate(&dsp, &voice);
+    }
+    double vsinc = (now() - start) / samples;
+
+    start = now();
+    for (unsigned i = 0; i < samples; ++i) {
+        voice.interp_pos = (i * 0x3A7) & 0x7FFF;
+        sink += refSinc(&voice);
+    }
+    double ssinc = (now() - start) / samples;
+
+    printf("%u samples, ns/sample (vector / scalar):\n", samples);
+    printf("  sinc: %.3f / %.3f\n", vsinc, ssinc);
+
+    return 0;
+}
@@ -69,7 +69,10 @@ static int16_t abuf_out[(SAMPLERATE / 50) << 1];
 
 // Core Options
 static int run_ahead_frames = 0;
+static unsigned ff_frameskip = 0;
 static int rsqual = 0;
+static unsigned audiomode = Bsnes::Audio::Mode::Resampled;
+static unsigned pixfmt = Bsnes::Video::PixelFormat::XRGB8888;
 static int aspect_ratio_mode = 0;
 static int overscan_t = 8;
 static int overscan_b = 8;
@@ -87,9 +90,14 @@ static std::ifstream msu_file_audio;
 static std::ifstream msu_file_data;
 static bool statecontexts = false;
 static bool bitmasks = false;
+static bool candupe = false;
 static bool addon = false;
 static int hmult = 2;
 static int vmult = 1;
+static bool frame_sent = false;
+static unsigned frame_w = 0;
+static unsigned frame_h = 0;
+static size_t frame_pitch = 0;
 
 // libretro callbacks
 static retro_log_printf_t log_cb = NULL;
@@ -247,6 +255,26 @@ static void check_variables(bool first_run) {
                 rsqual = 2;
         }
 
+        var.key   = "bsnes_jg_audio_output";
+        var.value = NULL;
+        if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+            if (!strcmp(var.value, "resampled"))
+                audiomode = Bsnes::Audio::Mode::Resampled;
+            else if (!strcmp(var.value, "native"))
+                audiomode = Bsnes::Audio::Mode::Native;
+        }
+
+        var.key   = "bsnes_jg_pixel_format";
+        var.value = NULL;
+        if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value) {
+            if (!strcmp(var.value, "xrgb8888"))
+                pixfmt = Bsnes::Video::PixelFormat::XRGB8888;
+            else if (!strcmp(var.value, "rgb565"))
+                pixfmt = Bsnes::Video::PixelFormat::RGB565;
+            else if (!strcmp(var.value, "0rgb1555"))
+                pixfmt = Bsnes::Video::PixelFormat::XRGB1555;
+        }
+
         var.key = "bsnes_jg_competition_timer";
         var.value = NULL;
 
@@ -272,6 +300,24 @@ static void check_variables(bool first_run) {
             Bsnes::setSpcInterpolation(Bsnes::Audio::Interpolation::Sinc);
     }
 
+    // Fast PPU
+    var.key   = "bsnes_jg_fast_ppu";
+    var.value = NULL;
+    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+        Bsnes::setFastPPU(!strcmp(var.value, "on"));
+
+    // Fast-Forward Frame Skip
+    var.key   = "bsnes_jg_ff_frameskip";
+    var.value = NULL;
+    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+        ff_frameskip = atoi(var.value);
+
+    // Render Threads
+    var.key   = "bsnes_jg_render_threads";
+    var.value = NULL;
+    if (environ_cb(RETRO_ENVIRONMENT_GET_VARIABLE, &var) && var.value)
+        Bsnes::setRenderThreads(atoi(var.value));
+
     // Aspect Ratio
     var.key   = "bsnes_jg_aspect";
     var.value = NULL;
@@ -546,18 +592,30 @@ static void audioFrame(const void*, size_t numsamps) {
     audio_batch_cb(abuf_out, numsamps >> 1);
 }
 
+static void audioFrameNative(const void*, const int16_t *samples, size_t numsamps) {
+    audio_batch_cb(samples, numsamps >> 1);
+}
+
 static void videoFrame(const void*, unsigned w, unsigned h, unsigned pitch) {
-    uint32_t *vptr = vbuf;
+    unsigned bpp = pixfmt == Bsnes::Video::PixelFormat::XRGB8888 ? 4 : 2;
+    uint8_t *vptr = (uint8_t*)vbuf;
     hmult = w / VIDEO_WIDTH;
     vmult = h / VIDEO_HEIGHT;
 
-    vptr += overscan_t * pitch * vmult;
+    vptr += overscan_t * pitch * vmult * bpp;
     h -= (overscan_t + overscan_b) * vmult;
 
-    vptr += (hmult * overscan_l);
+    vptr += (hmult * overscan_l) * bpp;
     w -= (overscan_l + overscan_r) * hmult;
 
-    video_cb(vptr, w, h, pitch << 2);
+    frame_sent = true;
+    frame_w = w;
+    frame_h = h;
+    frame_pitch = pitch * bpp;
+
+    // Let the frontend reuse the previous frame if nothing was drawn over it
+    video_cb(candupe && !Bsnes::getVideoFrameChanged() ? NULL : vptr,
+        w, h, pitch * bpp);
 }
 
 static int pollNull(const void*, unsigned, unsigned) {
@@ -706,8 +764,13 @@ static bool loadRom(void*, unsigned id) {
 
 static bool prepareLoadGame() {
     enum retro_pixel_format fmt = RETRO_PIXEL_FORMAT_XRGB8888;
+    if (pixfmt == Bsnes::Video::PixelFormat::RGB565)
+        fmt = RETRO_PIXEL_FORMAT_RGB565;
+    else if (pixfmt == Bsnes::Video::PixelFormat::XRGB1555)
+        fmt = RETRO_PIXEL_FORMAT_0RGB1555;
+
     if (!environ_cb(RETRO_ENVIRONMENT_SET_PIXEL_FORMAT, &fmt)) {
-        log_cb(RETRO_LOG_INFO, "XRGB8888 unsupported\n");
+        log_cb(RETRO_LOG_INFO, "Pixel format unsupported\n");
         return false;
     }
 
@@ -733,8 +796,9 @@ static bool finishLoadGame() {
 
     // Set up audio/video
     unsigned spf(SAMPLERATE / (Bsnes::getRegion() ? TIMING_PAL : TIMING_NTSC));
-    Bsnes::setAudioSpec({double(SAMPLERATE), spf << 1, 0, abuf, nullptr, &audioFrame});
-    Bsnes::setVideoSpec({vbuf, nullptr, &videoFrame});
+    Bsnes::setAudioSpec({double(SAMPLERATE), spf << 1, 0, abuf, nullptr,
+        &audioFrame, audiomode, &audioFrameNative});
+    Bsnes::setVideoSpec({vbuf, nullptr, &videoFrame, pixfmt});
 
     // Power up!
     Bsnes::power();
@@ -755,6 +819,10 @@ void retro_init(void) {
     if (environ_cb(RETRO_ENVIRONMENT_GET_INPUT_BITMASKS, NULL))
         bitmasks = true;
 
+    // Check if frontend allows repeating the previous frame
+    if (!environ_cb(RETRO_ENVIRONMENT_GET_CAN_DUPE, &candupe))
+        candupe = false;
+
     if (environ_cb(RETRO_ENVIRONMENT_GET_SAVESTATE_CONTEXT, NULL))
         statecontexts = true;
     else
@@ -826,7 +894,8 @@ void retro_get_system_info(struct retro_system_info *info) {
 void retro_get_system_av_info(struct retro_system_av_info *info) {
     info->timing = (struct retro_system_timing) {
         .fps = Bsnes::getRegion() ? TIMING_PAL : TIMING_NTSC,
-        .sample_rate = SAMPLERATE
+        .sample_rate = audiomode == Bsnes::Audio::Mode::Native ?
+            Bsnes::getAudioNativeRate() : SAMPLERATE
     };
 
     info->geometry = (struct retro_game_geometry) {
@@ -948,10 +1017,18 @@ void retro_run(void) {
 
     bool fastforwarding = false;
     environ_cb(RETRO_ENVIRONMENT_GET_FASTFORWARDING, &fastforwarding);
+
+    // Skipped frames are only possible if the previous frame can be repeated
+    Bsnes::setFrameSkip(fastforwarding && candupe ? ff_frameskip : 0);
+
+    frame_sent = false;
     if (fastforwarding || !run_ahead_frames)
         Bsnes::run();
     else
         Bsnes::runAhead(run_ahead_frames);
+
+    if (!frame_sent && candupe)
+        video_cb(NULL, frame_w, frame_h, frame_pitch);
 }
 
 bool retro_load_game(const struct retro_game_info *info) {
@@ -111,6 +111,18 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "fast"
    },
+   {
+      "bsnes_jg_audio_output",
+      "Audio Output (Restart)",
+      "Send the S-DSP's native 32 kHz samples straight to the frontend instead of resampling internally. "
+      "MSU-1 and Super Game Boy audio are not available with native output.",
+      {
+         { "resampled", "Resampled (Default)" },
+         { "native", "Native" },
+         { NULL, NULL },
+      },
+      "resampled"
+   },
    {
       "bsnes_jg_spc_interp",
       "SPC Interpolation Algorithm",
@@ -123,6 +135,59 @@ struct retro_core_option_definition option_defs_us[] = {
       },
       "gaussian"
    },
+   {
+      "bsnes_jg_fast_ppu",
+      "Fast PPU",
+      "Render whole scanlines at once for more speed at the cost of accuracy in games "
+      "which change PPU registers mid-scanline",
+      {
+         { "off", "Off (Default)" },
+         { "on", "On" },
+         { NULL, NULL },
+      },
+      "off"
+   },
+   {
+      "bsnes_jg_render_threads",
+      "Render Threads",
+      "Composite scanlines on additional threads to take work off the main emulation thread. "
+      "Has no effect on platforms without thread support.",
+      {
+         { "0", "0 (Default)" },
+         { "1", "1 thread" },
+         { "2", "2 threads" },
+         { "4", "4 threads" },
+         { "8", "8 threads" },
+         { NULL, NULL },
+      },
+      "0"
+   },
+   {
+      "bsnes_jg_ff_frameskip",
+      "Fast-Forward Frame Skip",
+      "Skip drawing frames while fast-forwarding. Emulation is unaffected, only the frames are not shown.",
+      {
+         { "0", "Off (Default)" },
+         { "1", "1 frame" },
+         { "2", "2 frames" },
+         { "3", "3 frames" },
+         { "4", "4 frames" },
+         { NULL, NULL },
+      },
+      "0"
+   },
+   {
+      "bsnes_jg_pixel_format",
+      "Pixel Format (Restart)",
+      "Set the colour depth of the video output. 16-bit formats halve the memory bandwidth used for each frame.",
+      {
+         { "xrgb8888", "XRGB8888 (Default)" },
+         { "rgb565", "RGB565" },
+         { "0rgb1555", "0RGB1555" },
+         { NULL, NULL },
+      },
+      "xrgb8888"
+   },
    {
       "bsnes_jg_aspect",
       "Aspect Ratio",
@@ -18,6 +18,8 @@
  * along with this program. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <cstdint>
 #include <cstring>
@@ -27,6 +29,71 @@
 
 namespace SuperFamicom {
 
+RingBuffer::~RingBuffer() {
+  delete[] data;
+}
+
+// Capacity is rounded up to a power of two so indices wrap with a mask
+void RingBuffer::resize(size_t capacity) {
+  size_t cap = 1;
+  while (cap < capacity) cap <<= 1;
+  delete[] data;
+  data = new float[cap]();
+  mask = cap - 1;
+  head.store(0, std::memory_order_relaxed);
+  tail.store(0, std::memory_order_relaxed);
+}
+
+size_t RingBuffer::size() const {
+  return head.load(std::memory_order_acquire) -
+    tail.load(std::memory_order_acquire);
+}
+
+// Producer side: samples which do not fit are dropped
+size_t RingBuffer::write(const float *in, size_t count) {
+  if (data == nullptr) return 0;
+  size_t w = head.load(std::memory_order_relaxed);
+  size_t r = tail.load(std::memory_order_acquire);
+  count = std::min(count, mask + 1 - (w - r));
+
+  size_t start = w & mask;
+  size_t first = std::min(count, mask + 1 - start);
+  memcpy(data + start, in, first * sizeof(float));
+  memcpy(data, in + first, (count - first) * sizeof(float));
+
+  head.store(w + count, std::memory_order_release);
+  return count;
+}
+
+// Consumer side: copy out up to count samples
+size_t RingBuffer::read(float *out, size_t count) {
+  size_t r = tail.load(std::memory_order_relaxed);
+  size_t w = head.load(std::memory_order_acquire);
+  count = std::min(count, w - r);
+
+  size_t start = r & mask;
+  size_t first = std::min(count, mask + 1 - start);
+  memcpy(out, data + start, first * sizeof(float));
+  memcpy(out + first, data, (count - first) * sizeof(float));
+
+  tail.store(r + count, std::memory_order_release);
+  return count;
+}
+
+// Consumer side: add up to count samples into out
+size_t RingBuffer::mix(float *out, size_t count) {
+  size_t r = tail.load(std::memory_order_relaxed);
+  size_t w = head.load(std::memory_order_acquire);
+  count = std::min(count, w - r);
+
+  for (size_t i = 0; i < count; ++i) {
+    out[i] += data[(r + i) & mask];
+  }
+
+  tail.store(r + count, std::memory_order_release);
+  return count;
+}
+
 void Audio::setFrequency(double frequency) {
   _frequency = frequency;
 }
@@ -42,6 +109,8 @@ void Audio::setCallback(void *ptr, void (*cb)(const void*, size_t)) {
 
 void Audio::setSpf(unsigned spf) {
   _spf = spf;
+  frame.assign(spf, 0.0f);
+  output.resize(spf << 3); // Up to 8 frames of latency for the reader
 }
 
 // Low to High
@@ -50,61 +119,136 @@ void Audio::setQuality(unsigned rsqual) {
 }
 
 Stream* Audio::createStream(double frequency) {
+  // The first stream sets the mixing rate and the size of a resampled block
+  if (_streams.empty()) {
+    if (srcstate == nullptr) {
+      int err;
+      srcstate = src_new(_rsqual, 2, &err); // 2 channels
+      memset(&srcdata, 0, sizeof(SRC_DATA)); // MUST be zero initialized
+    }
+
+    src_reset(srcstate);
+    _mixFrequency = frequency;
+    unsigned spf_in = (unsigned)(frequency / ((_frequency / _spf)));
+    if (spf_in & 1) --spf_in; // 2 channels means samples per frame must be even
+    queue_in.assign(std::max(spf_in, 2U), 0.0f);
+    resamp_out.assign(_spf << 1, 0.0f);
+    queue_out.resize(_spf << 3);
+  }
+
   Stream *stream = new Stream;
   stream->reset(frequency);
   _streams.push_back(stream);
   return stream;
 }
 
-Stream::~Stream() {
-    srcstate = src_delete(srcstate);
-    srcstate = nullptr;
-    queue_in.clear();
-    queue_out.clear();
-    free(resamp_out);
+// Native output bypasses the streams: S-DSP samples go to the host as-is
+void Audio::setNative(bool native) {
+  _native = native;
 }
 
-void Stream::reset(double freq_in) {
-  if (srcstate == nullptr) {
-    int err;
-    srcstate = src_new(audio._rsqual, 2, &err); // 2 channels
-    memset(&srcdata, 0, sizeof(SRC_DATA)); // MUST be zero initialized
-  }
+void Audio::setNativeCallback(void (*cb)(const void*, const int16_t*, size_t)) {
+  audioNative = cb;
+}
+
+void Audio::writeNative(const int16_t *samples, size_t count) {
+  if (audioNative) audioNative(udata, samples, count);
+}
 
-  src_reset(srcstate);
-  setFrequency(freq_in, audio._frequency);
-  queue_in.reserve(audio._spf << 1);
-  queue_out.reserve(audio._spf << 1);
-  resamp_out = (float*)calloc((audio._spf << 1), sizeof(float));
+// Scales every stream's resampling ratio, so a host can steer its buffer level
+void Audio::setRateAdjust(double ratio) {
+  _rateAdjust.store(std::max(0.9, std::min(ratio, 1.1)), std::memory_order_relaxed);
 }
 
-void Stream::setFrequency(double freq_in, double freq_out) {
-  inputFrequency = freq_in;
-  if (freq_out) {
-    outputFrequency = freq_out;
+size_t Audio::read(float *out, size_t count) {
+  return output.read(out, count);
+}
+
+size_t Audio::buffered() const {
+  return output.size();
+}
+
+void Stream::reset(double frequency) {
+  // Room for several blocks in case other streams fall behind this one
+  queue.resize(audio.queue_in.size() << 3);
+  memset(history, 0, sizeof(history));
+  hpos = 0;
+  phase = 0.0;
+  setFrequency(frequency);
+}
+
+// Windowed sinc coefficients for each phase, cut off below the lower Nyquist
+void Stream::setFrequency(double frequency) {
+  const double pi = 3.14159265358979323846;
+  direct = frequency == audio._mixFrequency;
+  if (direct) return;
+
+  step = frequency / audio._mixFrequency;
+  double cutoff = 0.85 * std::min(1.0, 1.0 / step);
+  filter.resize(Phases * Taps);
+
+  for (unsigned p = 0; p < Phases; ++p) {
+    float *f = &filter[p * Taps];
+    double sum = 0.0;
+    for (unsigned k = 0; k < Taps; ++k) {
+      // Distance from the output position, which lies between taps
+      // Taps / 2 - 1 and Taps / 2, and the matching Blackman window position
+      double x = k - (Taps / 2 - 1.0) - (double)p / Phases;
+      double n = (x + Taps / 2) / Taps;
+      double w = 0.42 - 0.5 * cos(2 * pi * n) + 0.08 * cos(4 * pi * n);
+      double c = x == 0.0 ? cutoff : sin(pi * cutoff * x) / (pi * x);
+      f[k] = c * w;
+      sum += f[k];
+    }
+    for (unsigned k = 0; k < Taps; ++k) f[k] /= sum; // Unity gain at DC
   }
-  srcdata.src_ratio = outputFrequency / inputFrequency;
-  spf_in = (unsigned)(inputFrequency / ((outputFrequency / audio._spf)));
-  if (spf_in & 1) --spf_in; // 2 channels means samples per frame must be even
 }
 
-void Stream::write(const int16_t samples[]) {
-  queue_in.push_back(samples[0] / 32768.0f);
-  queue_in.push_back(samples[1] / 32768.0f);
-
-  if (queue_in.size() == spf_in) {
-    srcdata.data_in = queue_in.data();
-    srcdata.data_out = resamp_out;
-    srcdata.input_frames = spf_in >> 1;
-    srcdata.output_frames = audio._spf;
-    src_process(srcstate, &srcdata);
-    queue_in.clear();
-
-    for (int i = 0; i < srcdata.output_frames_gen << 1; ++i) {
-      queue_out.push_back(resamp_out[i]);
+void Stream::push(float left, float right) {
+  if (direct) {
+    float samples[2] = {left, right};
+    queue.write(samples, 2);
+    return;
+  }
+
+  history[0][hpos] = history[0][hpos + Taps] = left;
+  history[1][hpos] = history[1][hpos + Taps] = right;
+  hpos = (hpos + 1) % Taps;
+
+  // Every output position before the next input frame, oldest tap first
+  const float *l = &history[0][hpos];
+  const float *r = &history[1][hpos];
+  for (; phase < 1.0; phase += step) {
+    const float *f = &filter[(unsigned)(phase * Phases) * Taps];
+    float samples[2] = {0.0f, 0.0f};
+    for (unsigned k = 0; k < Taps; ++k) {
+      samples[0] += f[k] * l[k];
+      samples[1] += f[k] * r[k];
     }
+    queue.write(samples, 2);
+  }
+  phase -= 1.0;
+}
+
+void Stream::write(const int16_t samples[]) {
+  if (audio._native) return;
+  push(samples[0] / 32768.0f, samples[1] / 32768.0f);
+  if (queue.size() >= audio.queue_in.size()) audio.process();
+}
 
-    audio.process();
+// Block of interleaved stereo samples, converted in as few runs as possible
+void Stream::write(const int16_t samples[], unsigned frames) {
+  if (audio._native) return;
+  float buf[256];
+  unsigned count = frames << 1;
+  while (count) {
+    unsigned run = std::min(count, 256U);
+    src_short_to_float_array(samples, buf, run);
+    if (direct) queue.write(buf, run);
+    else for (unsigned i = 0; i < run; i += 2) push(buf[i], buf[i + 1]);
+    samples += run;
+    count -= run;
+    if (queue.size() >= audio.queue_in.size()) audio.process();
   }
 }
 
@@ -119,22 +263,54 @@ void Audio::reset() {
     delete stream;
   }
   _streams.clear();
+  // Recreated by the next stream, so a new quality setting takes effect
+  srcstate = src_delete(srcstate);
 }
 
+// Mix a block from every stream once all of them have one, then resample it.
+// If a secondary stream falls behind while the S-DSP has two blocks waiting,
+// it is mixed as far as it goes and padded with silence, so the S-DSP's own
+// samples are never dropped from a full queue
 void Audio::process() {
-  for (Stream*& stream : _streams) {
-      if (stream->queue_out.size() < _spf) return;
-  }
+  size_t block = queue_in.size();
+  if (_spf == 0) return; // No output spec
+  RingBuffer &primary = _streams[0]->queue;
+  while (primary.size() >= block) {
+    if (primary.size() < block << 1) {
+      for (size_t i = 1; i < _streams.size(); ++i) {
+        if (_streams[i]->queue.size() < block) return;
+      }
+    }
 
-  for (Stream*& stream : _streams) {
-    for (unsigned i = 0; i < _spf; ++i) {
-      buffer[i] += stream->queue_out[i];
+    primary.read(queue_in.data(), block);
+    for (size_t i = 1; i < _streams.size(); ++i) {
+      _streams[i]->queue.mix(queue_in.data(), block);
     }
-    stream->queue_out.erase(stream->queue_out.begin(), stream->queue_out.begin() + _spf);
+
+    resample();
   }
+}
 
-  audioFrame(udata, _spf);
-  memset(&buffer[0], 0.0, _spf * sizeof(float));
+void Audio::resample() {
+  // A changed ratio is ramped to across this block by libsamplerate
+  srcdata.src_ratio = _frequency / _mixFrequency *
+    _rateAdjust.load(std::memory_order_relaxed);
+  srcdata.data_in = queue_in.data();
+  srcdata.data_out = resamp_out.data();
+  srcdata.input_frames = queue_in.size() >> 1;
+  srcdata.output_frames = _spf;
+  src_process(srcstate, &srcdata);
+
+  queue_out.write(resamp_out.data(), srcdata.output_frames_gen << 1);
+
+  // Output every whole frame available, as rate adjustment can produce more
+  // than one per block. Without a callback, frames are queued for Audio::read
+  float *out = audioFrame ? buffer : frame.data();
+  while (queue_out.size() >= _spf) {
+    queue_out.read(out, _spf);
+    if (audioFrame) audioFrame(udata, _spf);
+    else output.write(out, _spf);
+  }
 }
 
 }
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -31,6 +33,24 @@ struct Interface;
 struct Audio;
 struct Stream;
 
+//fixed-capacity single producer, single consumer queue of samples; the two
+//indices only ever increase, and each side only stores its own index, so one
+//thread may write while another reads without locking
+struct RingBuffer {
+  ~RingBuffer();
+  void resize(std::size_t);
+  std::size_t size() const;
+  std::size_t write(const float*, std::size_t);
+  std::size_t read(float*, std::size_t);
+  std::size_t mix(float*, std::size_t);
+
+private:
+  float *data = nullptr;
+  std::size_t mask = 0;
+  std::atomic<std::size_t> head{0};
+  std::atomic<std::size_t> tail{0};
+};
+
 struct Audio {
   ~Audio();
   Stream* createStream(double);
@@ -40,44 +60,78 @@ struct Audio {
   void setCallback(void*, void (*)(const void*, std::size_t));
   void setSpf(unsigned);
   void setQuality(unsigned);
+  void setNative(bool);
+  void setNativeCallback(void (*)(const void*, const int16_t*, std::size_t));
+  void setRateAdjust(double);
+  std::size_t read(float*, std::size_t);
+  std::size_t buffered() const;
+
+  bool native() const { return _native; }
+  void writeNative(const int16_t*, std::size_t);
 
 private:
-  void (*audioFrame)(const void*, std::size_t);
+  void (*audioFrame)(const void*, std::size_t) = nullptr;
+  void (*audioNative)(const void*, const int16_t*, std::size_t) = nullptr;
   void process();
+  void resample();
 
   void *udata = nullptr;
+  bool _native = false;
 
   std::vector<Stream*> _streams;
 
   double _frequency = 48000.0;
+  double _mixFrequency = 0.0;
+  std::atomic<double> _rateAdjust{1.0}; //may be set from the reader's thread
   unsigned _rsqual = SRC_SINC_FASTEST;
   unsigned _spf = 0;
   float *buffer = nullptr;
 
+  //streams are mixed at the rate of the first one created, the S-DSP, and
+  //the mix is resampled to the output rate once
+  SRC_STATE *srcstate = nullptr;
+  SRC_DATA srcdata;
+  std::vector<float> queue_in;
+  std::vector<float> resamp_out;
+  RingBuffer queue_out;
+
+  //mixed frames awaiting read() when there is no callback
+  std::vector<float> frame;
+  RingBuffer output;
+
   friend struct Stream;
 };
 
 struct Stream {
-  ~Stream();
-  void reset(double);
-  void setFrequency(double, double);
+  void setFrequency(double);
   void write(const int16_t samples[]);
+  void write(const int16_t samples[], unsigned frames);
 
   template<typename... P> void sample(P&&... p) {
     int16_t samples[sizeof...(P)] = {std::forward<P>(p)...};
     write(samples);
   }
 
-  SRC_STATE *srcstate = nullptr;
-  SRC_DATA srcdata;
-  std::vector<float> queue_in;
-  std::vector<float> queue_out;
-  float *resamp_out;
-  unsigned spf_in = 0;
-
 private:
-  double inputFrequency;
-  double outputFrequency = 48000.0;
+  void reset(double);
+  void push(float, float);
+
+  //samples at the mixing rate, waiting for the other streams to catch up
+  RingBuffer queue;
+
+  //streams at other rates are converted by a fixed polyphase filter: the
+  //last Taps input frames per channel, stored twice so any window of them is
+  //contiguous, and one set of coefficients per fractional output position
+  static constexpr unsigned Taps = 16;
+  static constexpr unsigned Phases = 256;
+  std::vector<float> filter;
+  float history[2][Taps << 1] = {};
+  unsigned hpos = 0;
+  double step = 1.0; //input frames per output frame
+  double phase = 0.0;
+  bool direct = true;
+
+  friend struct Audio;
 };
 
 extern Audio audio;
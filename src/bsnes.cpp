@@ -21,6 +21,7 @@
 #include <algorithm>
 #include <cstddef>
 #include <cstring>
+#include <vector>
 
 #include "audio.hpp"
 #include "cartridge.hpp"
@@ -34,6 +35,7 @@
 #include "expansion/expansion.hpp"
 #include "logger.hpp"
 #include "ppu.hpp"
+#include "rewind.hpp"
 #include "serializer.hpp"
 #include "settings.hpp"
 #include "system.hpp"
@@ -49,6 +51,7 @@ bool Bsnes::loaded() {
 }
 
 bool Bsnes::load() {
+  SuperFamicom::rewinder.reset();
   return SuperFamicom::system.load();
 }
 
@@ -57,6 +60,7 @@ void Bsnes::save() {
 }
 
 void Bsnes::unload() {
+  SuperFamicom::rewinder.reset();
   SuperFamicom::system.unload();
 }
 
@@ -69,23 +73,40 @@ void Bsnes::reset() {
 }
 
 void Bsnes::run() {
+  SuperFamicom::rewinder.capture();
   SuperFamicom::system.run();
 }
 
+void Bsnes::runNoRender() {
+  SuperFamicom::rewinder.capture();
+  SuperFamicom::system.run(/* render = */ false);
+}
+
 void Bsnes::runAhead(unsigned frames) {
   if (!frames)
     return;
 
+  // Saved every frame, so the buffer is kept rather than allocated each time
+  static std::vector<uint8_t> state;
+  state.resize(SuperFamicom::system.serializeCapacity());
+  serializer s(state.data(), state.size(), serializer::Mode::Save);
+
+  SuperFamicom::rewinder.capture();
   SuperFamicom::system.runAhead = true;
   SuperFamicom::system.run();
-  serializer s = SuperFamicom::system.serialize(false); // deterministic
+  SuperFamicom::system.serialize(s, false); // deterministic
+  uint64_t base = DirtyPages::advance();
 
   for (unsigned i = 0; i < frames - 1; ++i)
     SuperFamicom::system.run();
 
   SuperFamicom::system.runAhead = false;
   SuperFamicom::system.run();
+
+  // Only the pages written while running ahead are restored, so the rest
+  // still count as unchanged for rewind captures and incremental saves
   s.setMode(serializer::Mode::Load);
+  s.setBase(base);
   SuperFamicom::system.unserialize(s);
 }
 
@@ -93,6 +114,22 @@ bool Bsnes::getRtcPresent() {
   return (SuperFamicom::cartridge.has.EpsonRTC || SuperFamicom::cartridge.has.SharpRTC);
 }
 
+unsigned Bsnes::getContextSwitches() {
+  return SuperFamicom::scheduler.frameSwitches;
+}
+
+const uint8_t* Bsnes::getVideoDirtyLines() {
+  return SuperFamicom::ppu.dirty.lines;
+}
+
+bool Bsnes::getVideoFrameChanged() {
+  return SuperFamicom::ppu.dirty.frame;
+}
+
+double Bsnes::getAudioNativeRate() {
+  return SuperFamicom::system.apuFrequency() / 768.0;
+}
+
 std::pair<void*, unsigned> Bsnes::getMemoryRaw(unsigned type) {
   switch (type) {
     default: case Memory::CartRAM:
@@ -118,16 +155,35 @@ unsigned Bsnes::serializeSize() {
 }
 
 unsigned Bsnes::serialize(uint8_t *data) {
-  serializer s = SuperFamicom::system.serialize(true);
-  std::memcpy(data, s.data(), s.size());
+  serializer s(data, SuperFamicom::system.serializeSize(true), serializer::Mode::Save);
+  if (!SuperFamicom::system.serialize(s, true)) return 0;
   return s.size();
 }
 
+uint64_t Bsnes::serializeIncremental(uint8_t *data, uint64_t base) {
+  serializer s(data, SuperFamicom::system.serializeSize(true), serializer::Mode::Save);
+  s.setBase(base);
+  if (!SuperFamicom::system.serialize(s, true)) return 0;
+  return DirtyPages::advance();
+}
+
 bool Bsnes::unserialize(const uint8_t *data, unsigned size) {
   serializer s(data, size);
   return SuperFamicom::system.unserialize(s);
 }
 
+void Bsnes::rewindEnable(unsigned seconds, unsigned interval) {
+  SuperFamicom::rewinder.enable(seconds, interval);
+}
+
+bool Bsnes::rewindStep() {
+  if (!SuperFamicom::rewinder.step())
+    return false;
+
+  SuperFamicom::system.run();
+  return true;
+}
+
 void Bsnes::cheatsClear() {
   if (!SuperFamicom::cartridge.has.ICD) {
     SuperFamicom::Memory::GlobalWriteEnable = true;
@@ -172,6 +228,20 @@ void Bsnes::setAudioSpec(Audio::Spec spec) {
   SuperFamicom::audio.setQuality(spec.rsqual);
   SuperFamicom::audio.setBuffer(spec.buf);
   SuperFamicom::audio.setCallback(spec.ptr, spec.cb);
+  SuperFamicom::audio.setNative(spec.mode == Audio::Mode::Native);
+  SuperFamicom::audio.setNativeCallback(spec.nativecb);
+}
+
+size_t Bsnes::Audio::read(float *buf, size_t frames) {
+  return SuperFamicom::audio.read(buf, frames << 1) >> 1;
+}
+
+size_t Bsnes::Audio::buffered() {
+  return SuperFamicom::audio.buffered() >> 1;
+}
+
+void Bsnes::Audio::setRateAdjust(double ratio) {
+  SuperFamicom::audio.setRateAdjust(ratio);
 }
 
 void Bsnes::setCoprocDelayedSync(bool value) {
@@ -186,6 +256,26 @@ void Bsnes::setHotfixes(bool value) {
   SuperFamicom::configuration.hotfixes = value;
 }
 
+void Bsnes::setFastPPU(bool value) {
+  SuperFamicom::configuration.fastPPU = value;
+}
+
+void Bsnes::setRenderThreads(unsigned threads) {
+  SuperFamicom::configuration.renderThreads = threads;
+}
+
+void Bsnes::setFrameSkip(unsigned frames) {
+  SuperFamicom::configuration.frameSkip = frames;
+}
+
+void Bsnes::setFrameSkipAudio(bool value) {
+  SuperFamicom::configuration.frameSkipAudio = value;
+}
+
+void Bsnes::setEntropy(unsigned level) {
+  SuperFamicom::configuration.entropy = level;
+}
+
 void Bsnes::setDIPSwitches(uint8_t value) {
   SuperFamicom::dip.value = value;
 }
@@ -280,6 +370,13 @@ void Bsnes::setWriteCallback(void *ptr, void (*cb)(void*, std::string, const uin
 }
 
 void Bsnes::setVideoSpec(Video::Spec spec) {
+  if (spec.pixfmt > Video::PixelFormat::RGB565) {
+    logger.log(Logger::WRN, std::string("Unknown pixel format: ") +
+      std::to_string(spec.pixfmt) + ", using XRGB8888\n");
+    spec.pixfmt = Video::PixelFormat::XRGB8888;
+  }
+
+  SuperFamicom::ppu.setPixelFormat((SuperFamicom::PPU::PixelFormat)spec.pixfmt);
   SuperFamicom::ppu.setBuffer(spec.buf);
   SuperFamicom::ppu.setCallback(spec.ptr, spec.cb);
 }
@@ -37,9 +37,50 @@ namespace Bsnes {
       unsigned rsqual;                  /**< Resampler quality: 0-2 for fast, medium, or best */
       float *buf;                       /**< Buffer for internally resampled and mixed audio samples */
       void *ptr;                        /**< User data passed to callback */
-      void (*cb)(const void*, size_t);  /**< Callback for audio output */
+      void (*cb)(const void*, size_t);  /**< Callback for audio output, or nullptr to use Audio::read */
+      unsigned mode;                    /**< Output mode, see Audio::Mode */
+      void (*nativecb)(const void*, const int16_t*, size_t); /**< Callback for Native mode output */
     } Spec;
 
+    namespace Mode {
+      /** Mixed float samples resampled to the output frequency */
+      constexpr unsigned Resampled  = 0;
+      /**
+       * Interleaved stereo int16 samples from the S-DSP at the native rate,
+       * delivered once per frame through nativecb with the sample count.
+       * The output frequency, resampler and float callbacks are unused, and
+       * MSU-1 and Super Game Boy audio are not available.
+       */
+      constexpr unsigned Native     = 1;
+    }
+
+    /**
+     * Read mixed audio when no callback is set. This may be called from a
+     * thread other than the one running the emulator without locking.
+     * Up to 8 frames are held; samples produced while it is full are dropped.
+     * @param buf Buffer for interleaved stereo samples
+     * @param frames Maximum number of stereo sample frames to read
+     * @return Number of stereo sample frames read
+     */
+    size_t read(float *buf, size_t frames);
+
+    /**
+     * Number of stereo sample frames waiting to be read with Audio::read.
+     * This is always 0 when a callback is set.
+     * @return Number of stereo sample frames buffered
+     */
+    size_t buffered();
+
+    /**
+     * Adjust the resampling ratio for dynamic rate control. Values above 1.0
+     * produce more samples per emulated frame, filling the host's buffer
+     * faster. Changes are ramped in over the next block of samples rather
+     * than applied as a step. This may be called from any thread and has no
+     * effect in Native mode.
+     * @param ratio Adjustment to the nominal ratio, clamped to 0.9-1.1
+     */
+    void setRateAdjust(double ratio);
+
     namespace Interpolation {
       constexpr unsigned Gaussian   = 0;    /**< Gaussian */
       constexpr unsigned Sinc       = 1;    /**< Sinc */
@@ -47,13 +88,20 @@ namespace Bsnes {
   }
 
   namespace Video {
+    namespace PixelFormat {
+      constexpr unsigned XRGB8888 = 0;  /**< 32-bit, 8 bits per channel */
+      constexpr unsigned XRGB1555 = 1;  /**< 16-bit, 5 bits per channel */
+      constexpr unsigned RGB565   = 2;  /**< 16-bit, 6 bits for green */
+    }
+
     /**
      * Video Specifications - Specify video parameters
      */
     typedef struct _Spec {
-      uint32_t *buf;                                            /**< Buffer for raw pixel data */
+      void *buf;                                                /**< Buffer for raw pixel data, 512x480 pixels */
       void *ptr;                                                /**< User data passed to callback */
-      void (*cb)(const void*, unsigned, unsigned, unsigned);    /**< Callback for video output */
+      void (*cb)(const void*, unsigned, unsigned, unsigned);    /**< Callback for video output: width (256 or 512), height and pitch in pixels */
+      unsigned pixfmt;                                          /**< PixelFormat of the buffer, unknown values select XRGB8888 */
     } Spec;
   }
 
@@ -122,6 +170,12 @@ namespace Bsnes {
     constexpr unsigned PAL =    1;  /**< PAL: UK, Europe, Australia */
   }
 
+  namespace Entropy {
+    constexpr unsigned None =   0;  /**< No randomization (deterministic) */
+    constexpr unsigned Low =    1;  /**< Patterned with sparse random bits */
+    constexpr unsigned High =   2;  /**< Fully random */
+  }
+
   /**
    * Determine if content is loaded
    * @return Content is loaded
@@ -159,6 +213,12 @@ namespace Bsnes {
    */
   void run();
 
+  /**
+   * Run one frame of emulation without drawing it or calling the video
+   * callback, regardless of frame skipping
+   */
+  void runNoRender();
+
   /**
    * Run multiple frames of emulation in advance to reduce input latency
    * @param frames Number of frames to run ahead
@@ -172,20 +232,49 @@ namespace Bsnes {
   unsigned serializeSize();
 
   /**
-   * Serialize emulated system state (save state)
-   * @param data Empty buffer to store state data
-   * @return Size of state in bytes
+   * Serialize emulated system state (save state) directly into a buffer
+   * @param data Buffer of at least serializeSize() bytes to store state data
+   * @return Size of state in bytes, or 0 on failure
    */
   unsigned serialize(uint8_t *data);
 
   /**
-   * Unserialize emulated system state (load state)
-   * @param data Buffer containing state data
+   * Serialize emulated system state over a state previously saved into the
+   * same buffer this way, rewriting only the pages of WRAM, VRAM, APU RAM and
+   * save RAM written since. The result is a complete state, as from serialize().
+   * Writes made through getMemoryRaw() pointers are not seen.
+   * @param data Buffer of at least serializeSize() bytes to store state data
+   * @param base Value returned when the buffer was last saved, or 0 to save all
+   * @return Value to pass as base when next saving over the buffer, 0 on failure
+   */
+  uint64_t serializeIncremental(uint8_t *data, uint64_t base);
+
+  /**
+   * Unserialize emulated system state (load state) directly from a buffer
+   * @param data Buffer containing state data, which is not copied
    * @param size Size of buffer containing state data
-   * @return Success/fail
+   * @return Success/fail. If a state fails after loading has begun, the
+   *         system is powered on again rather than left half loaded
    */
   bool unserialize(const uint8_t *data, unsigned size);
 
+  /**
+   * Keep a history of states to rewind through, captured by the run functions
+   * using deterministic states. The newest state is held whole and older ones
+   * as compressed differences, so this costs far less than storing states.
+   * @param seconds Length of the history, or 0 to disable it and free memory
+   * @param interval Frames run between captured states
+   */
+  void rewindEnable(unsigned seconds, unsigned interval);
+
+  /**
+   * Step back through the rewind history, restoring the previous state and
+   * running one frame from it. Call this instead of a run function for each
+   * frame while rewinding. Once the oldest state is reached, it is repeated.
+   * @return Success/fail, false if there is no history
+   */
+  bool rewindStep();
+
   /**
    * Deactivate all cheats and clear the cheat list
    */
@@ -216,7 +305,33 @@ namespace Bsnes {
   bool getRtcPresent();
 
   /**
-   * Retrieve pointer to and size of raw data
+   * Determine the number of context switches between emulated chips
+   * @return Context switches during the last complete frame
+   */
+  unsigned getContextSwitches();
+
+  /**
+   * Determine which lines of the last video frame changed since the one before
+   * it, valid from the video callback until the next frame is sent
+   * @return Bitmap with bit (y & 7) of byte (y >> 3) set if line y changed
+   */
+  const uint8_t* getVideoDirtyLines();
+
+  /**
+   * Determine whether the last video frame differs from the one before it
+   * @return Any line of the last video frame changed
+   */
+  bool getVideoFrameChanged();
+
+  /**
+   * Determine the rate of Native mode audio output, valid once content is loaded
+   * @return S-DSP output frequency (Hz)
+   */
+  double getAudioNativeRate();
+
+  /**
+   * Retrieve pointer to and size of raw data. Writes through the pointer are
+   * not tracked, so save in full and re-enable rewind after making any.
    * @param type Type of raw data to retrieve
    * @return Pointer to and size of raw data
    */
@@ -258,6 +373,39 @@ namespace Bsnes {
    */
   void setHotfixes(bool value);
 
+  /**
+   * Render whole scanlines at once for more speed at the cost of accuracy
+   * @param value on/off
+   */
+  void setFastPPU(bool value);
+
+  /**
+   * Set the number of host threads compositing scanlines, applied at the
+   * start of the next frame. Has no effect if built without threads.
+   * @param threads Number of threads, 0 to composite on the emulation thread
+   */
+  void setRenderThreads(unsigned threads);
+
+  /**
+   * Set the number of frames left undrawn after each frame drawn by run(),
+   * during which the video callback is not called
+   * @param frames Number of frames to skip, 0 to draw every frame
+   */
+  void setFrameSkip(unsigned frames);
+
+  /**
+   * Output audio for frames which are not drawn, or discard it before
+   * resampling
+   * @param value on/off
+   */
+  void setFrameSkipAudio(bool value);
+
+  /**
+   * Set the amount of randomness in the power-on state, applied at power on
+   * @param level Entropy level: 0-2 for None, Low, High
+   */
+  void setEntropy(unsigned level);
+
   /**
    * Set the value of any available DIP switches
    * @param value 8 DIP switches with each bit representing one switch
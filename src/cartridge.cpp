@@ -185,6 +185,16 @@ std::string Cartridge::loadBoard(std::string node) {
   return {};
 }
 
+//plain memory may be accessed directly by the bus, bypassing the handlers.
+//ReadableMemory writes must go through the handler to honour GlobalWriteEnable.
+static uint8_t* directRead(ReadableMemory& memory) { return memory.data(); }
+static uint8_t* directRead(WritableMemory& memory) { return memory.data(); }
+template<typename T> static uint8_t* directRead(T&) { return nullptr; }
+static uint8_t* directWrite(WritableMemory& memory) { return memory.data(); }
+template<typename T> static uint8_t* directWrite(T&) { return nullptr; }
+static DirtyPages* directWritten(WritableMemory& memory) { return &memory.written; }
+template<typename T> static DirtyPages* directWritten(T&) { return nullptr; }
+
 template<typename T>  //T = ReadableMemory, WritableMemory
 unsigned Cartridge::loadMap(std::string map, T& memory) {
   std::string addr = BML::search(map, {"map", "address"});
@@ -196,7 +206,8 @@ unsigned Cartridge::loadMap(std::string map, T& memory) {
   unsigned mask = strmask.empty() ? 0 : std::stoi(strmask, nullptr, 16);
   if(size == 0) size = memory.size();
   if(size == 0) return 0; //does this ever actually occur? - Yes! Sufami Turbo.
-  return bus.map({&T::read, &memory}, {&T::write, &memory}, addr, size, base, mask);
+  return bus.map({&T::read, &memory}, {&T::write, &memory}, addr, size, base, mask,
+    directRead(memory), directWrite(memory), directWritten(memory));
 }
 
 unsigned Cartridge::loadMap(
@@ -284,7 +295,7 @@ void Cartridge::saveMemory(Memory& sram, std::string node) {
 }
 
 void Cartridge::serialize(serializer& s) {
-  s.array(ram.data(), ram.size());
+  s.array(ram.data(), ram.size(), ram.written);
 }
 
 std::pair<void*, unsigned> Cartridge::getMemoryRaw(unsigned type) {
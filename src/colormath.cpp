@@ -0,0 +1,222 @@
+/*
+ * bsnes-jg - Super Nintendo emulator
+ *
+ * Copyright (C) 2004-2020 byuu
+ * Copyright (C) 2020-2022 Rupert Carmichael
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, specifically version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#if defined(__AVX2__)
+  #include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+  #include <emmintrin.h>
+  #define COLORMATH_SSE2
+#elif defined(__ARM_NEON)
+  #include <arm_neon.h>
+#endif
+
+#include "colormath.hpp"
+
+//the scalar formulas only ever need 16 bits per pixel, so the vector versions
+//are the same operations on 16-bit lanes: 8 pixels per SSE2/NEON register or
+//16 per AVX2 register, four registers per loop iteration
+
+namespace SuperFamicom {
+namespace ColorMath {
+
+#if defined(__AVX2__)
+static inline __m256i blend(__m256i x, __m256i y, __m256i halve, bool subtract) {
+  const __m256i mask0421 = _mm256_set1_epi16(0x0421);
+  const __m256i mask8420 = _mm256_set1_epi16((int16_t)0x8420);
+  __m256i xy = _mm256_xor_si256(x, y);
+  __m256i whole, half;
+
+  if(!subtract) {
+    __m256i sum = _mm256_add_epi16(x, y);
+    __m256i low = _mm256_sub_epi16(sum, _mm256_and_si256(xy, mask0421));
+    __m256i carry = _mm256_and_si256(low, mask8420);
+    whole = _mm256_or_si256(_mm256_sub_epi16(sum, carry),
+      _mm256_sub_epi16(carry, _mm256_srli_epi16(carry, 5)));
+    half = _mm256_srli_epi16(low, 1);
+  } else {
+    __m256i diff = _mm256_add_epi16(_mm256_sub_epi16(x, y), mask8420);
+    __m256i borrow = _mm256_and_si256(
+      _mm256_sub_epi16(diff, _mm256_and_si256(xy, mask8420)), mask8420);
+    whole = _mm256_and_si256(_mm256_sub_epi16(diff, borrow),
+      _mm256_sub_epi16(borrow, _mm256_srli_epi16(borrow, 5)));
+    half = _mm256_srli_epi16(
+      _mm256_and_si256(whole, _mm256_set1_epi16(0x7bde)), 1);
+  }
+
+  return _mm256_blendv_epi8(whole, half, halve);
+}
+
+static inline __m256i scale(__m256i channel, __m256i level, __m256i round) {
+  __m256i product = _mm256_add_epi16(_mm256_mullo_epi16(channel, level), round);
+  return _mm256_mulhi_epu16(product, _mm256_set1_epi16(2185));
+}
+
+static inline __m256i brightness(__m256i color, __m256i level) {
+  const __m256i mask = _mm256_set1_epi16(31);
+  const __m256i round = _mm256_set1_epi16(15);
+  __m256i r = scale(_mm256_and_si256(color, mask), level, round);
+  __m256i g = scale(_mm256_and_si256(_mm256_srli_epi16(color, 5), mask), level, round);
+  __m256i b = scale(_mm256_and_si256(_mm256_srli_epi16(color, 10), mask), level, round);
+  return _mm256_or_si256(r, _mm256_or_si256(_mm256_slli_epi16(g, 5), _mm256_slli_epi16(b, 10)));
+}
+#elif defined(COLORMATH_SSE2)
+static inline __m128i blend(__m128i x, __m128i y, __m128i halve, bool subtract) {
+  const __m128i mask0421 = _mm_set1_epi16(0x0421);
+  const __m128i mask8420 = _mm_set1_epi16((int16_t)0x8420);
+  __m128i xy = _mm_xor_si128(x, y);
+  __m128i whole, half;
+
+  if(!subtract) {
+    __m128i sum = _mm_add_epi16(x, y);
+    __m128i low = _mm_sub_epi16(sum, _mm_and_si128(xy, mask0421));
+    __m128i carry = _mm_and_si128(low, mask8420);
+    whole = _mm_or_si128(_mm_sub_epi16(sum, carry),
+      _mm_sub_epi16(carry, _mm_srli_epi16(carry, 5)));
+    half = _mm_srli_epi16(low, 1);
+  } else {
+    __m128i diff = _mm_add_epi16(_mm_sub_epi16(x, y), mask8420);
+    __m128i borrow = _mm_and_si128(
+      _mm_sub_epi16(diff, _mm_and_si128(xy, mask8420)), mask8420);
+    whole = _mm_and_si128(_mm_sub_epi16(diff, borrow),
+      _mm_sub_epi16(borrow, _mm_srli_epi16(borrow, 5)));
+    half = _mm_srli_epi16(_mm_and_si128(whole, _mm_set1_epi16(0x7bde)), 1);
+  }
+
+  return _mm_or_si128(_mm_and_si128(halve, half), _mm_andnot_si128(halve, whole));
+}
+
+static inline __m128i scale(__m128i channel, __m128i level, __m128i round) {
+  __m128i product = _mm_add_epi16(_mm_mullo_epi16(channel, level), round);
+  return _mm_mulhi_epu16(product, _mm_set1_epi16(2185));
+}
+
+static inline __m128i brightness(__m128i color, __m128i level) {
+  const __m128i mask = _mm_set1_epi16(31);
+  const __m128i round = _mm_set1_epi16(15);
+  __m128i r = scale(_mm_and_si128(color, mask), level, round);
+  __m128i g = scale(_mm_and_si128(_mm_srli_epi16(color, 5), mask), level, round);
+  __m128i b = scale(_mm_and_si128(_mm_srli_epi16(color, 10), mask), level, round);
+  return _mm_or_si128(r, _mm_or_si128(_mm_slli_epi16(g, 5), _mm_slli_epi16(b, 10)));
+}
+#elif defined(__ARM_NEON)
+static inline uint16x8_t blend(uint16x8_t x, uint16x8_t y, uint16x8_t halve, bool subtract) {
+  const uint16x8_t mask0421 = vdupq_n_u16(0x0421);
+  const uint16x8_t mask8420 = vdupq_n_u16(0x8420);
+  uint16x8_t xy = veorq_u16(x, y);
+  uint16x8_t whole, half;
+
+  if(!subtract) {
+    uint16x8_t sum = vaddq_u16(x, y);
+    uint16x8_t low = vsubq_u16(sum, vandq_u16(xy, mask0421));
+    uint16x8_t carry = vandq_u16(low, mask8420);
+    whole = vorrq_u16(vsubq_u16(sum, carry), vsubq_u16(carry, vshrq_n_u16(carry, 5)));
+    half = vshrq_n_u16(low, 1);
+  } else {
+    uint16x8_t diff = vaddq_u16(vsubq_u16(x, y), mask8420);
+    uint16x8_t borrow = vandq_u16(vsubq_u16(diff, vandq_u16(xy, mask8420)), mask8420);
+    whole = vandq_u16(vsubq_u16(diff, borrow), vsubq_u16(borrow, vshrq_n_u16(borrow, 5)));
+    half = vshrq_n_u16(vandq_u16(whole, vdupq_n_u16(0x7bde)), 1);
+  }
+
+  return vbslq_u16(halve, half, whole);
+}
+
+static inline uint16x8_t scale(uint16x8_t channel, uint16x8_t level) {
+  uint16x8_t product = vmlaq_u16(vdupq_n_u16(15), channel, level);
+  uint32x4_t lo = vmull_u16(vget_low_u16(product), vdup_n_u16(2185));
+  uint32x4_t hi = vmull_u16(vget_high_u16(product), vdup_n_u16(2185));
+  return vcombine_u16(vshrn_n_u32(lo, 16), vshrn_n_u32(hi, 16));
+}
+
+static inline uint16x8_t brightness(uint16x8_t color, uint16x8_t level) {
+  const uint16x8_t mask = vdupq_n_u16(31);
+  uint16x8_t r = scale(vandq_u16(color, mask), level);
+  uint16x8_t g = scale(vandq_u16(vshrq_n_u16(color, 5), mask), level);
+  uint16x8_t b = scale(vandq_u16(vshrq_n_u16(color, 10), mask), level);
+  return vorrq_u16(r, vorrq_u16(vshlq_n_u16(g, 5), vshlq_n_u16(b, 10)));
+}
+#endif
+
+void blend(uint16_t *out, const uint16_t *x, const uint16_t *y,
+  const uint16_t *halve, unsigned count, bool subtract) {
+  unsigned i = 0;
+
+  #if defined(__AVX2__)
+  for(; i + 64 <= count; i += 64) {
+    for(unsigned n = i; n < i + 64; n += 16) {
+      __m256i vx = _mm256_loadu_si256((const __m256i*)(x + n));
+      __m256i vy = _mm256_loadu_si256((const __m256i*)(y + n));
+      __m256i vh = _mm256_loadu_si256((const __m256i*)(halve + n));
+      _mm256_storeu_si256((__m256i*)(out + n), blend(vx, vy, vh, subtract));
+    }
+  }
+  #elif defined(COLORMATH_SSE2)
+  for(; i + 32 <= count; i += 32) {
+    for(unsigned n = i; n < i + 32; n += 8) {
+      __m128i vx = _mm_loadu_si128((const __m128i*)(x + n));
+      __m128i vy = _mm_loadu_si128((const __m128i*)(y + n));
+      __m128i vh = _mm_loadu_si128((const __m128i*)(halve + n));
+      _mm_storeu_si128((__m128i*)(out + n), blend(vx, vy, vh, subtract));
+    }
+  }
+  #elif defined(__ARM_NEON)
+  for(; i + 32 <= count; i += 32) {
+    for(unsigned n = i; n < i + 32; n += 8) {
+      vst1q_u16(out + n, blend(vld1q_u16(x + n), vld1q_u16(y + n), vld1q_u16(halve + n), subtract));
+    }
+  }
+  #endif
+
+  for(; i < count; ++i) out[i] = blend(x[i], y[i], subtract, halve[i]);
+}
+
+void brightness(uint16_t *out, const uint16_t *in, unsigned count, unsigned level) {
+  unsigned i = 0;
+
+  #if defined(__AVX2__)
+  __m256i vl = _mm256_set1_epi16(level * 2);
+  for(; i + 64 <= count; i += 64) {
+    for(unsigned n = i; n < i + 64; n += 16) {
+      __m256i color = _mm256_loadu_si256((const __m256i*)(in + n));
+      _mm256_storeu_si256((__m256i*)(out + n), brightness(color, vl));
+    }
+  }
+  #elif defined(COLORMATH_SSE2)
+  __m128i vl = _mm_set1_epi16(level * 2);
+  for(; i + 32 <= count; i += 32) {
+    for(unsigned n = i; n < i + 32; n += 8) {
+      __m128i color = _mm_loadu_si128((const __m128i*)(in + n));
+      _mm_storeu_si128((__m128i*)(out + n), brightness(color, vl));
+    }
+  }
+  #elif defined(__ARM_NEON)
+  uint16x8_t vl = vdupq_n_u16(level * 2);
+  for(; i + 32 <= count; i += 32) {
+    for(unsigned n = i; n < i + 32; n += 8) {
+      vst1q_u16(out + n, brightness(vld1q_u16(in + n), vl));
+    }
+  }
+  #endif
+
+  for(; i < count; ++i) out[i] = brightness(in[i], level);
+}
+
+}
+}
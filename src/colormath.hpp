@@ -0,0 +1,69 @@
+/*
+ * bsnes-jg - Super Nintendo emulator
+ *
+ * Copyright (C) 2004-2020 byuu
+ * Copyright (C) 2020-2022 Rupert Carmichael
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, specifically version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+//color math and brightness on BGR555 colors, one pixel at a time for the
+//cycle renderer and a whole scanline at a time for PPU::Line
+
+namespace SuperFamicom {
+namespace ColorMath {
+
+//add or subtract y from x per channel with clamping, optionally halving
+inline unsigned blend(unsigned x, unsigned y, bool subtract, bool halve) {
+  if(!subtract) {
+    if(!halve) {
+      unsigned sum = x + y;
+      unsigned carry = (sum - ((x ^ y) & 0x0421)) & 0x8420;
+      return (sum - carry) | (carry - (carry >> 5));
+    } else {
+      return (x + y - ((x ^ y) & 0x0421)) >> 1;
+    }
+  } else {
+    unsigned diff = x - y + 0x8420;
+    unsigned borrow = (diff - ((x ^ y) & 0x8420)) & 0x8420;
+    if(!halve) {
+      return   (diff - borrow) & (borrow - (borrow >> 5));
+    } else {
+      return (((diff - borrow) & (borrow - (borrow >> 5))) & 0x7bde) >> 1;
+    }
+  }
+}
+
+//scale each channel by level / 15, rounded to nearest
+inline unsigned brightness(unsigned color, unsigned level) {
+  if(level == 15) return color;
+  unsigned r = ((color >>  0 & 31) * level * 2 + 15) * 2185 >> 16;
+  unsigned g = ((color >>  5 & 31) * level * 2 + 15) * 2185 >> 16;
+  unsigned b = ((color >> 10 & 31) * level * 2 + 15) * 2185 >> 16;
+  return b << 10 | g << 5 | r << 0;
+}
+
+//out[i] = blend(x[i], y[i], subtract, halve[i]), with halve[i] 0 or 0xffff
+void blend(uint16_t *out, const uint16_t *x, const uint16_t *y,
+  const uint16_t *halve, unsigned count, bool subtract);
+
+//out[i] = brightness(in[i], level)
+void brightness(uint16_t *out, const uint16_t *in, unsigned count, unsigned level);
+
+}
+}
@@ -38,8 +38,6 @@ static GB_gameboy_t sameboy;
 
 namespace SuperFamicom {
 
-static Stream *stream;
-
 ICD icd;
 
 uint8_t& ICD::Packet::operator[](uint8_t address) {
@@ -73,7 +71,7 @@ void ICD::ppuWrite(uint8_t color) {
 
 void ICD::apuWrite(int16_t left, int16_t right) {
   int16_t samples[] = {left, right};
-  if(!system.runAhead) stream->write(samples);
+  if(!system.runAhead && !system.skipAudio) stream->write(samples);
 }
 
 void ICD::joypWrite(bool p14, bool p15) {
@@ -235,7 +233,7 @@ void ICD::writeIO(unsigned addr, uint8_t data) {
     case 3: this->frequency = freq / 9; break;  //very slow
     }
 
-    stream->setFrequency(this->frequency / 128, 0);
+    stream->setFrequency(this->frequency / 128);
     r6003 = data;
     return;
   }
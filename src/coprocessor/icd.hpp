@@ -26,6 +26,8 @@
 
 namespace SuperFamicom {
 
+struct Stream;
+
 struct ICD : Thread {
   inline unsigned pathID() const;
 
@@ -73,6 +75,8 @@ private:
   void *udata_v;
   void *udata_wr;
 
+  Stream *stream = nullptr;
+
   Packet packet[64];
   uint8_t packetSize;
 
@@ -31,8 +31,6 @@
 
 namespace SuperFamicom {
 
-static Stream *stream;
-
 MSU1 msu1;
 
 void MSU1::serialize(serializer& s) {
@@ -102,7 +100,7 @@ void MSU1::main() {
     }
   }
 
-  if(!system.runAhead) stream->sample(left, right);
+  if(!system.runAhead && !system.skipAudio) stream->sample(left, right);
   step(1);
   synchronizeCPU();
 }
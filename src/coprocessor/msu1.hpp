@@ -24,6 +24,8 @@
 
 namespace SuperFamicom {
 
+struct Stream;
+
 struct MSU1 : Thread {
   void setOpenMsuCallback(void*, bool (*)(void*, std::string, std::istream**));
 
@@ -44,6 +46,7 @@ struct MSU1 : Thread {
 private:
   std::istream *dataFile = nullptr;
   std::istream *audioFile = nullptr;
+  Stream *stream = nullptr;
   void *udata;
 
   enum Flag : unsigned {
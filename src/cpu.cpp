@@ -445,6 +445,7 @@ uint8_t CPU::readDMA(unsigned addr, uint8_t data) {
 
 void CPU::writeRAM(unsigned addr, uint8_t data) {
   wram[addr] = data;
+  wramWritten.mark(addr);
 }
 
 void CPU::writeAPU(unsigned addr, uint8_t data) {
@@ -963,7 +964,7 @@ void CPU::serialize(serializer& s) {
   Thread::serialize(s);
   PPUcounter::serialize(s);
 
-  s.array(wram);
+  s.array(wram, wramWritten);
 
   s.integer(version);
 
@@ -1065,7 +1066,7 @@ void CPU::synchronizeSMP() {
 }
 
 void CPU::synchronizePPU() {
-  if(ppu.clock < 0) scheduler.resume(ppu.thread);
+  if(ppu.clock < 0 && !ppu.skipIdle()) scheduler.resume(ppu.thread);
 }
 
 void CPU::synchronizeCoprocessors() {
@@ -1124,10 +1125,12 @@ void CPU::power(bool reset) {
   bfunction<uint8_t (unsigned, uint8_t)> reader;
   bfunction<void  (unsigned, uint8_t)> writer;
 
+  wramWritten.resize(sizeof(wram));
+
   reader = {&CPU::readRAM, this};
   writer = {&CPU::writeRAM, this};
-  bus.map(reader, writer, "00-3f,80-bf:0000-1fff", 0x2000);
-  bus.map(reader, writer, "7e-7f:0000-ffff", 0x20000);
+  bus.map(reader, writer, "00-3f,80-bf:0000-1fff", 0x2000, 0, 0, wram, wram, &wramWritten);
+  bus.map(reader, writer, "7e-7f:0000-ffff", 0x20000, 0, 0, wram, wram, &wramWritten);
 
   reader = {&CPU::readAPU, this};
   writer = {&CPU::writeAPU, this};
@@ -99,6 +99,7 @@ struct CPU : Processor::WDC65816, Thread, PPUcounter {
   void serialize(serializer&);
 
   uint8_t wram[128 * 1024];
+  DirtyPages wramWritten;
   std::vector<Thread*> coprocessors;
 
 private:
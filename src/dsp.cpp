@@ -19,6 +19,7 @@
  */
 
 #include <cstring>
+#include <new>
 
 #include "audio.hpp"
 #include "serializer.hpp"
@@ -26,14 +27,19 @@
 
 #include "dsp.hpp"
 
-#include "snes_spc/spc_dsp.h"
-
 namespace SuperFamicom {
 
-static Stream *stream;
-
 DSP dsp;
 
+DSP::DSP() {
+  core = spc_dsp_new();
+  if(!core) throw std::bad_alloc();
+}
+
+DSP::~DSP() {
+  spc_dsp_delete(core);
+}
+
 static void dsp_state_save(unsigned char** out, void* in, size_t size) {
   memcpy(*out, in, size);
   *out += size;
@@ -49,7 +55,13 @@ void DSP::quirk() {
 }
 
 void DSP::serialize(serializer& s) {
-  s.array(apuram);
+  //take the pages written by echo since the last state
+  unsigned char* echoPages = spc_dsp_echo_pages(core);
+  for(unsigned page = 0; page < 0x100; ++page) {
+    if(echoPages[page]) apuramWritten.mark(page << 8);
+    echoPages[page] = 0;
+  }
+  s.array(apuram, apuramWritten);
   s.array(samplebuffer);
   s.integer(clock);
 
@@ -57,39 +69,44 @@ void DSP::serialize(serializer& s) {
   unsigned char* p = state;
   memset(&state, 0, SPC_STATE_SIZE);
   if(s.mode() == serializer::Save) {
-    spc_dsp_copy_state(&p, dsp_state_save);
+    spc_dsp_copy_state(core, &p, dsp_state_save);
     s.array(state);
   } else if(s.mode() == serializer::Load) {
     s.array(state);
-    spc_dsp_copy_state(&p, dsp_state_load);
+    spc_dsp_copy_state(core, &p, dsp_state_load);
   } else {
     s.array(state);
   }
 }
 
+//run every clock owed to the SMP in one call, rounding up to whole DSP clocks
 void DSP::main() {
-  spc_dsp_run(1);
-  clock += 2;
+  int clocks = (int)((1 - clock) >> 1);
+  spc_dsp_run(core, clocks);
+  clock += clocks << 1;
+
+  //native output is held for a whole frame unless the buffer fills first
+  int count = spc_dsp_sample_count(core);
+  if(count > 0 && (!audio.native() || count >= 4096)) flush();
+}
 
-  int count = spc_dsp_sample_count();
+void DSP::flush() {
+  int count = spc_dsp_sample_count(core);
   if(count > 0) {
-    if(!system.runAhead) {
-      for(int n = 0; n < count; n += 2) {
-        int16_t left  = samplebuffer[n + 0];
-        int16_t right = samplebuffer[n + 1];
-        stream->sample(left, right);
-      }
+    if(!system.runAhead && !system.skipAudio) {
+      if(audio.native()) audio.writeNative(samplebuffer, count);
+      else stream->write(samplebuffer, count >> 1);
     }
-    spc_dsp_set_output(samplebuffer, 8192);
+    spc_dsp_set_output(core, samplebuffer, 8192);
   }
 }
 
 uint8_t DSP::read(uint8_t address) {
-  return spc_dsp_read(address);
+  return spc_dsp_read(core, address);
 }
 
 void DSP::write(uint8_t address, uint8_t data) {
-  spc_dsp_write(address, data);
+  spc_dsp_write(core, address, data);
 }
 
 bool DSP::load() {
@@ -98,27 +115,28 @@ bool DSP::load() {
 
 void DSP::power(bool reset) {
   clock = 0;
+  apuramWritten.resize(sizeof(apuram));
   stream = audio.createStream(system.apuFrequency() / 768.0);
 
   if(!reset) {
-    spc_dsp_init(apuram);
-    spc_dsp_reset();
-    spc_dsp_set_output(samplebuffer, 8192);
+    spc_dsp_init(core, apuram);
+    spc_dsp_reset(core);
+    spc_dsp_set_output(core, samplebuffer, 8192);
   } else {
-    spc_dsp_soft_reset();
-    spc_dsp_set_output(samplebuffer, 8192);
+    spc_dsp_soft_reset(core);
+    spc_dsp_set_output(core, samplebuffer, 8192);
   }
 
   if(init)
-    for(unsigned address = 0; address < 0x80; ++address) spc_dsp_write(address, 0xff);
+    for(unsigned address = 0; address < 0x80; ++address) spc_dsp_write(core, address, 0xff);
 }
 
 bool DSP::mute() {
-  return spc_dsp_mute();
+  return spc_dsp_mute(core);
 }
 
 void DSP::setInterpolation(int interp) {
-  spc_dsp_set_interpolation(interp);
+  spc_dsp_set_interpolation(core, interp);
 }
 
 }
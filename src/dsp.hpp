@@ -20,12 +20,26 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+
+#include "snes_spc/spc_dsp.h"
+
+#include "serializer.hpp"
+
 namespace SuperFamicom {
 
+struct Stream;
+
 struct DSP {
+  DSP();
+  ~DSP();
+
   uint8_t apuram[64 * 1024] = {};
+  DirtyPages apuramWritten;
 
   void main();
+  void flush();
   uint8_t read(uint8_t);
   void write(uint8_t, uint8_t);
 
@@ -41,6 +55,8 @@ struct DSP {
   int64_t clock = 0;
 
 private:
+  spc_dsp_t *core = nullptr;
+  Stream *stream = nullptr;
   bool init = false;
   int16_t samplebuffer[8192];
 };
@@ -25,7 +25,7 @@
 namespace SuperFamicom {
 
 //incremented only when serialization format changes
-static const std::string SerializerVersion = "115";
+static const std::string SerializerVersion = "117";
 
 struct Game {
   struct Memory;
@@ -20,6 +20,8 @@
 
 #pragma once
 
+#include <new>
+#include <type_traits>
 #include <utility>
 
 template <typename T, unsigned B>
@@ -28,6 +30,9 @@ inline T signextend(const T x) {
   return s.x = x;
 }
 
+//bfunction is a non-allocating delegate: the bound object (a member function
+//and object pointer, or a small lambda) is stored inline and called through a
+//plain function pointer. bound objects must be trivially copyable.
 template<typename T> struct bfunction;
 
 template<typename R, typename... P> struct bfunction<R (P...)> {
@@ -37,43 +42,35 @@ template<typename R, typename... P> struct bfunction<R (P...)> {
   };
 
   bfunction() {}
-  template<typename C> bfunction(R (C::*_bfunction)(P...), C* object) { callback = new member<C>(_bfunction, object); }
-  template<typename L, typename = typename std::enable_if<is_compatible<L>::value>::type> bfunction(const L& object) { callback = new lambda<L>(object); }
-  ~bfunction() { if(callback) delete callback; }
+  template<typename C> bfunction(R (C::*_bfunction)(P...), C* object) { bind(member<C>{_bfunction, object}); }
+  template<typename L, typename = typename std::enable_if<is_compatible<L>::value>::type> bfunction(const L& object) { bind(object); }
 
-  explicit operator bool() const { return callback; }
-  R operator()(P... p) const { return (*callback)(std::forward<P>(p)...); }
-  void reset() { if(callback) { delete callback; callback = nullptr; } }
-
-  bfunction& operator=(const bfunction& source) {
-    if(this != &source) {
-      if(callback) { delete callback; callback = nullptr; }
-      if(source.callback) callback = source.callback->copy();
-    }
-    return *this;
-  }
+  explicit operator bool() const { return invoke; }
+  R operator()(P... p) const { return invoke(&storage, std::forward<P>(p)...); }
+  void reset() { invoke = nullptr; }
 
 private:
-  struct container {
-    virtual R operator()(P... p) const = 0;
-    virtual container* copy() const = 0;
-    virtual ~container() = default;
-  };
-
-  container* callback = nullptr;
-
-  template<typename C> struct member : container {
+  template<typename C> struct member {
     R (C::*bfunction)(P...);
     C* object;
     R operator()(P... p) const { return (object->*bfunction)(std::forward<P>(p)...); }
-    container* copy() const { return new member(bfunction, object); }
-    member(R (C::*_bfunction)(P...), C* obj) : bfunction(_bfunction), object(obj) {}
   };
 
-  template<typename L> struct lambda : container {
-    mutable L object;
-    R operator()(P... p) const { return object(std::forward<P>(p)...); }
-    container* copy() const { return new lambda(object); }
-    lambda(const L& obj) : object(obj) {}
-  };
+  template<typename L> static R call(void* object, P... p) {
+    return (*static_cast<L*>(object))(std::forward<P>(p)...);
+  }
+
+  template<typename L> void bind(const L& object) {
+    static_assert(sizeof(L) <= sizeof(storage), "bfunction: bound object is too large");
+    static_assert(alignof(L) <= alignof(void*), "bfunction: bound object is overaligned");
+    static_assert(std::is_trivially_copyable<L>::value, "bfunction: bound object must be trivially copyable");
+    new(&storage) L(object);
+    invoke = &call<L>;
+  }
+
+  R (*invoke)(void*, P...) = nullptr;
+  mutable union {
+    void* align;
+    unsigned char bytes[4 * sizeof(void*)];
+  } storage;
 };
@@ -18,6 +18,7 @@
  * along with this program. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -34,8 +35,7 @@ Memory::~Memory() {
 }
 
 Bus::~Bus() {
-  if(lookup) delete[] lookup;
-  if(target) delete[] target;
+  if(page) delete[] page;
 }
 
 void Bus::reset() {
@@ -43,22 +43,97 @@ void Bus::reset() {
     reader[id].reset();
     writer[id].reset();
     counter[id] = 0;
+    directRead[id] = nullptr;
+    directWrite[id] = nullptr;
+    directWritten[id] = nullptr;
   }
 
-  if(lookup) delete[] lookup;
-  if(target) delete[] target;
-
-  lookup = new uint8_t [16 * 1024 * 1024]();
-  target = new uint32_t[16 * 1024 * 1024]();
+  if(page) delete[] page;
+  page = new Page[16 * 1024 * 1024 >> 8]();
+  fragment.clear();
+  fragmentFree.clear();
 
   reader[0] = [](unsigned, uint8_t data) -> uint8_t { return data; };
   writer[0] = [](unsigned, uint8_t) -> void {};
 }
 
+//map count bytes starting at addr (all within one page) to handler id
+void Bus::assign(unsigned addr, unsigned count, unsigned id, const uint32_t* offset) {
+  unsigned pn = addr >> 8;
+  unsigned first = addr & 0xff;
+
+  for(unsigned n = 0; n < count; ++n) {
+    unsigned pid = page[pn].fragmented ? fragment[page[pn].target].lookup[first + n] : page[pn].id;
+    if(pid && --counter[pid] == 0) {
+      reader[pid].reset();
+      writer[pid].reset();
+      directRead[pid] = nullptr;
+      directWrite[pid] = nullptr;
+      directWritten[pid] = nullptr;
+    }
+  }
+  if(id) counter[id] += count;
+
+  bool linear = count == 256;
+  for(unsigned n = 1; linear && id && n < count; ++n) linear = offset[n] == offset[0] + n;
+
+  if(!linear && !page[pn].fragmented) {
+    unsigned index;
+    if(fragmentFree.size()) {
+      index = fragmentFree.back();
+      fragmentFree.pop_back();
+    } else {
+      index = fragment.size();
+      fragment.push_back({});
+    }
+    Fragment& f = fragment[index];
+    for(unsigned n = 0; n < 256; ++n) {
+      f.lookup[n] = page[pn].id;
+      f.target[n] = page[pn].target + n;
+    }
+    page[pn].read = nullptr;
+    page[pn].write = nullptr;
+    page[pn].written = nullptr;
+    page[pn].target = index;
+    page[pn].fragmented = true;
+  }
+
+  if(!linear) {
+    Fragment& f = fragment[page[pn].target];
+    for(unsigned n = 0; n < count; ++n) {
+      f.lookup[first + n] = id;
+      f.target[first + n] = offset[n];
+    }
+
+    //collapse the fragment if the page now has a single linear mapping
+    linear = true;
+    for(unsigned n = 1; linear && n < 256; ++n) {
+      linear = f.lookup[n] == f.lookup[0] && (!f.lookup[0] || f.target[n] == f.target[0] + n);
+    }
+    if(!linear) return;
+    id = f.lookup[0];
+    offset = f.target;
+  }
+
+  if(page[pn].fragmented) fragmentFree.push_back(page[pn].target);
+  page[pn].read = directRead[id] ? directRead[id] + offset[0] : nullptr;
+  page[pn].write = nullptr;
+  page[pn].written = nullptr;
+  //direct writes mark the memory page written, so both pages must line up
+  if(directWrite[id] && !(offset[0] & 0xff)) {
+    page[pn].write = directWrite[id] + offset[0];
+    page[pn].written = directWritten[id]->page(offset[0]);
+  }
+  page[pn].id = id;
+  page[pn].target = id ? offset[0] : 0;
+  page[pn].fragmented = false;
+}
+
 unsigned Bus::map(
   const bfunction<uint8_t (unsigned, uint8_t)>& read,
   const bfunction<void  (unsigned, uint8_t)>& write,
-  const std::string& addr, unsigned size, unsigned base, unsigned mask
+  const std::string& addr, unsigned size, unsigned base, unsigned mask,
+  uint8_t* readData, uint8_t* writeData, DirtyPages* written
 ) {
   unsigned id = 1;
   while(counter[id]) {
@@ -68,6 +143,12 @@ unsigned Bus::map(
   reader[id] = read;
   writer[id] = write;
 
+  //memory which is accessed without side effects may be accessed directly.
+  //offsets are only bounded when size is known, and writes must be tracked.
+  directRead[id] = size ? readData : nullptr;
+  directWrite[id] = size && written ? writeData : nullptr;
+  directWritten[id] = directWrite[id] ? written : nullptr;
+
   std::stringstream ss(addr);
   std::vector<std::string> p;
   for (std::string i; std::getline(ss, i, ':'); p.push_back(i));
@@ -80,6 +161,8 @@ unsigned Bus::map(
   std::vector<std::string> addrs;
   for (std::string i; std::getline(ss, i, ','); addrs.push_back(i));
 
+  if(size) base = mirror(base, size);
+
   for (std::string& bank : banks) {
     ss.clear(); ss.str(bank);
     std::vector<unsigned> bankRange;
@@ -95,19 +178,15 @@ unsigned Bus::map(
       if (addrRange.size() == 1) addrRange.push_back(addrRange[0]);
 
       for(unsigned bank2 = bankRange[0]; bank2 <= bankRange[1]; ++bank2) {
-        for(unsigned addr3 = addrRange[0]; addr3 <= addrRange[1]; ++addr3) {
-          unsigned pid = lookup[bank2 << 16 | addr3];
-          if(pid && --counter[pid] == 0) {
-            reader[pid].reset();
-            writer[pid].reset();
+        for(unsigned addr3 = addrRange[0]; addr3 <= addrRange[1];) {
+          unsigned last = std::min(addrRange[1], addr3 | 0xff);
+          uint32_t offset[256];
+          for(unsigned n = addr3; n <= last; ++n) {
+            offset[n - addr3] = reduce(bank2 << 16 | n, mask);
+            if(size) offset[n - addr3] = base + mirror(offset[n - addr3], size - base);
           }
-
-          unsigned offset = reduce(bank2 << 16 | addr3, mask);
-          if(size) base = mirror(base, size);
-          if(size) offset = base + mirror(offset, size - base);
-          lookup[bank2 << 16 | addr3] = id;
-          target[bank2 << 16 | addr3] = offset;
-          ++counter[id];
+          assign(bank2 << 16 | addr3, last - addr3 + 1, id, offset);
+          addr3 = last + 1;
         }
       }
     }
@@ -129,28 +208,27 @@ void Bus::unmap(const std::string& addr) {
   std::vector<std::string> addrs;
   for (std::string i; std::getline(ss, i, ','); addrs.push_back(i));
 
+  const uint32_t offset[256] = {};
+
   for (std::string& bank : banks) {
     ss.clear(); ss.str(bank);
     std::vector<unsigned> bankRange;
     for (std::string i; std::getline(ss, i, '-');
       bankRange.push_back(std::stoul(i, nullptr, 16)));
+    if (bankRange.size() == 1) bankRange.push_back(bankRange[0]);
 
     for (std::string& addr2 : addrs) {
       ss.clear(); ss.str(addr2);
       std::vector<unsigned> addrRange;
       for (std::string i; std::getline(ss, i, '-');
         addrRange.push_back(std::stoul(i, nullptr, 16)));
+      if (addrRange.size() == 1) addrRange.push_back(addrRange[0]);
 
       for(unsigned bank2 = bankRange[0]; bank2 <= bankRange[1]; ++bank2) {
-        for(unsigned addr3 = addrRange[0]; addr3 <= addrRange[1]; ++addr3) {
-          unsigned pid = lookup[bank2 << 16 | addr3];
-          if(pid && --counter[pid] == 0) {
-            reader[pid].reset();
-            writer[pid].reset();
-          }
-
-          lookup[bank2 << 16 | addr3] = 0;
-          target[bank2 << 16 | addr3] = 0;
+        for(unsigned addr3 = addrRange[0]; addr3 <= addrRange[1];) {
+          unsigned last = std::min(addrRange[1], addr3 | 0xff);
+          assign(bank2 << 16 | addr3, last - addr3 + 1, 0, offset);
+          addr3 = last + 1;
         }
       }
     }
@@ -22,8 +22,10 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
 
 #include "function.hpp"
+#include "serializer.hpp"
 
 namespace SuperFamicom {
 
@@ -70,6 +72,9 @@ struct WritableMemory : Memory {
   inline void write(unsigned, uint8_t) override;
   inline uint8_t& operator[](unsigned);
 
+  //pages changed through write(), operator[] or the bus, but not data()
+  DirtyPages written;
+
 private:
   struct {
     uint8_t* data = nullptr;
@@ -90,17 +95,42 @@ struct Bus {
   unsigned map(
     const bfunction<uint8_t (unsigned, uint8_t)>&,
     const bfunction<void (unsigned, uint8_t)>&,
-    const std::string&, unsigned = 0, unsigned = 0, unsigned = 0
+    const std::string&, unsigned = 0, unsigned = 0, unsigned = 0,
+    uint8_t* = nullptr, uint8_t* = nullptr, DirtyPages* = nullptr
   );
   void unmap(const std::string&);
 
 private:
-  uint8_t *lookup = nullptr;
-  uint32_t *target = nullptr;
+  //the address space is divided into 256-byte pages. a page mapped to a single
+  //handler with a linear offset is stored directly; pages shared by several
+  //handlers (eg. MMIO ranges) point to a fragment with per-byte entries.
+  //linear pages of plain memory also hold pointers for direct access.
+  struct Page {
+    uint8_t* read;      //direct read pointer, or nullptr to use the handler
+    uint8_t* write;     //direct write pointer, or nullptr to use the handler
+    uint64_t* written;  //write epoch of the memory page, for direct writes
+    uint32_t target;    //offset of the first byte, or fragment index
+    uint8_t id;
+    bool fragmented;
+  };
+
+  struct Fragment {
+    uint8_t lookup[256];
+    uint32_t target[256];
+  };
+
+  void assign(unsigned, unsigned, unsigned, const uint32_t*);
+
+  Page *page = nullptr;
+  std::vector<Fragment> fragment;
+  std::vector<unsigned> fragmentFree;
 
   bfunction<uint8_t (unsigned, uint8_t)> reader[256];
   bfunction<void  (unsigned, uint8_t)> writer[256];
   unsigned counter[256];
+  uint8_t* directRead[256];
+  uint8_t* directWrite[256];
+  DirtyPages* directWritten[256];
 };
 
 extern Bus bus;
@@ -151,6 +181,7 @@ void WritableMemory::reset() {
   delete[] self.data;
   self.data = nullptr;
   self.size = 0;
+  written.resize(0);
 }
 
 void WritableMemory::allocate(unsigned size, uint8_t fill) {
@@ -161,6 +192,7 @@ void WritableMemory::allocate(unsigned size, uint8_t fill) {
   for(unsigned address = 0; address < size; ++address) {
     self.data[address] = fill;
   }
+  written.resize(size);
 }
 
 uint8_t* WritableMemory::data() {
@@ -177,9 +209,12 @@ uint8_t WritableMemory::read(unsigned address, uint8_t) {
 
 void WritableMemory::write(unsigned address, uint8_t data)  {
   self.data[address] = data;
+  written.mark(address);
 }
 
+//the page is marked, as the reference may be written through
 uint8_t& WritableMemory::operator[](unsigned address) {
+  written.mark(address);
   return self.data[address];
 }
 
@@ -209,11 +244,19 @@ unsigned Bus::reduce(unsigned addr, unsigned mask) {
 }
 
 uint8_t Bus::read(unsigned addr, uint8_t data) {
-  return reader[lookup[addr]](target[addr], data);
+  const Page& p = page[addr >> 8];
+  if(p.read) return p.read[addr & 0xff];
+  if(!p.fragmented) return reader[p.id](p.target + (addr & 0xff), data);
+  const Fragment& f = fragment[p.target];
+  return reader[f.lookup[addr & 0xff]](f.target[addr & 0xff], data);
 }
 
 void Bus::write(unsigned addr, uint8_t data) {
-  return writer[lookup[addr]](target[addr], data);
+  const Page& p = page[addr >> 8];
+  if(p.write) return (void)(p.write[addr & 0xff] = data, *p.written = DirtyPages::epoch);
+  if(!p.fragmented) return writer[p.id](p.target + (addr & 0xff), data);
+  const Fragment& f = fragment[p.target];
+  return writer[f.lookup[addr & 0xff]](f.target[addr & 0xff], data);
 }
 
 }
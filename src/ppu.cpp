@@ -22,6 +22,7 @@
 #include <cstring>
 
 #include "serializer.hpp"
+#include "colormath.hpp"
 #include "cpu.hpp"
 #include "memory.hpp"
 #include "random.hpp"
@@ -51,7 +52,12 @@ void PPU::main() {
     }*/
     display.interlace = io.interlace;
     display.overscan = io.overscan;
+    display.wide = display.interlace;
     obj.frame();
+
+    #if defined(HAVE_THREADS)
+    if(workers.size() != configuration.renderThreads) workers.resize(configuration.renderThreads);
+    #endif
   }
 
   mosaic.scanline();
@@ -62,12 +68,28 @@ void PPU::main() {
   obj.scanline();
   window.scanline();
   screen.scanline();
+  deferred = false;
+  queued = false;
 
   if(vcounter() > 240) {
     step(hperiod());
     return;
   }
 
+  //the scanline renderer draws the whole line at once, using the registers as
+  //they are at H=512, and leaves the PPU idle for the rest of the line
+  if(configuration.fastPPU) {
+    step(512);
+    renderLine();
+    step(hperiod() - hcounter());
+    return;
+  }
+
+  #if defined(HAVE_THREADS)
+  deferred = workers.size() && vcounter() > 0 && vcounter() <= 232 && !system.skipVideo;
+  captured = 0;
+  #endif
+
   #define cycles02(index) cycle<index>()
   #define cycles04(index) cycles02(index); cycles02(index +  2)
   #define cycles08(index) cycles04(index); cycles04(index +  4)
@@ -101,6 +123,15 @@ void PPU::main() {
   cycles16(1056);
   cycles08(1072);
   //H = 1080
+  if(deferred) {
+    queueLine();
+    deferred = false;
+  }
+  else if(vcounter() > 0 && vcounter() <= 232 && !system.skipVideo) {
+    unsigned width = display.wide ? 512 : 256;
+    hashLine(screen.lineA - width * pixelBytes, width);
+    if(screen.lineB != screen.lineA) hashLine(screen.lineB - width * pixelBytes, width);
+  }
   obj.fetch();
   //H = 1352 (max)
   step(hperiod() - hcounter());
@@ -119,77 +150,77 @@ void PPU::cycleObjectEvaluate() {
 }
 
 template<unsigned Cycle>
-void PPU::cycleBackgroundFetch() {
+void PPU::cycleBackgroundFetch(unsigned column) {
   switch(io.bgMode) {
   case 0:
-    if(Cycle == 0) bg4.fetchNameTable();
-    else if(Cycle == 1) bg3.fetchNameTable();
-    else if(Cycle == 2) bg2.fetchNameTable();
-    else if(Cycle == 3) bg1.fetchNameTable();
-    else if(Cycle == 4) bg4.fetchCharacter(0);
-    else if(Cycle == 5) bg3.fetchCharacter(0);
-    else if(Cycle == 6) bg2.fetchCharacter(0);
-    else if(Cycle == 7) bg1.fetchCharacter(0);
+    if(Cycle == 0) bg4.fetchNameTable(column);
+    else if(Cycle == 1) bg3.fetchNameTable(column);
+    else if(Cycle == 2) bg2.fetchNameTable(column);
+    else if(Cycle == 3) bg1.fetchNameTable(column);
+    else if(Cycle == 4) bg4.fetchCharacter(column, 0);
+    else if(Cycle == 5) bg3.fetchCharacter(column, 0);
+    else if(Cycle == 6) bg2.fetchCharacter(column, 0);
+    else if(Cycle == 7) bg1.fetchCharacter(column, 0);
     break;
   case 1:
-    if(Cycle == 0) bg3.fetchNameTable();
-    else if(Cycle == 1) bg2.fetchNameTable();
-    else if(Cycle == 2) bg1.fetchNameTable();
-    else if(Cycle == 3) bg3.fetchCharacter(0);
-    else if(Cycle == 4) bg2.fetchCharacter(0);
-    else if(Cycle == 5) bg2.fetchCharacter(1);
-    else if(Cycle == 6) bg1.fetchCharacter(0);
-    else if(Cycle == 7) bg1.fetchCharacter(1);
+    if(Cycle == 0) bg3.fetchNameTable(column);
+    else if(Cycle == 1) bg2.fetchNameTable(column);
+    else if(Cycle == 2) bg1.fetchNameTable(column);
+    else if(Cycle == 3) bg3.fetchCharacter(column, 0);
+    else if(Cycle == 4) bg2.fetchCharacter(column, 0);
+    else if(Cycle == 5) bg2.fetchCharacter(column, 1);
+    else if(Cycle == 6) bg1.fetchCharacter(column, 0);
+    else if(Cycle == 7) bg1.fetchCharacter(column, 1);
     break;
   case 2:
-    if(Cycle == 0) bg2.fetchNameTable();
-    else if(Cycle == 1) bg1.fetchNameTable();
-    else if(Cycle == 2) bg3.fetchOffset(0);
-    else if(Cycle == 3) bg3.fetchOffset(8);
-    else if(Cycle == 4) bg2.fetchCharacter(0);
-    else if(Cycle == 5) bg2.fetchCharacter(1);
-    else if(Cycle == 6) bg1.fetchCharacter(0);
-    else if(Cycle == 7) bg1.fetchCharacter(1);
+    if(Cycle == 0) bg2.fetchNameTable(column);
+    else if(Cycle == 1) bg1.fetchNameTable(column);
+    else if(Cycle == 2) bg3.fetchOffset(column, 0);
+    else if(Cycle == 3) bg3.fetchOffset(column, 8);
+    else if(Cycle == 4) bg2.fetchCharacter(column, 0);
+    else if(Cycle == 5) bg2.fetchCharacter(column, 1);
+    else if(Cycle == 6) bg1.fetchCharacter(column, 0);
+    else if(Cycle == 7) bg1.fetchCharacter(column, 1);
     break;
   case 3:
-    if(Cycle == 0) bg2.fetchNameTable();
-    else if(Cycle == 1) bg1.fetchNameTable();
-    else if(Cycle == 2) bg2.fetchCharacter(0);
-    else if(Cycle == 3) bg2.fetchCharacter(1);
-    else if(Cycle == 4) bg1.fetchCharacter(0);
-    else if(Cycle == 5) bg1.fetchCharacter(1);
-    else if(Cycle == 6) bg1.fetchCharacter(2);
-    else if(Cycle == 7) bg1.fetchCharacter(3);
+    if(Cycle == 0) bg2.fetchNameTable(column);
+    else if(Cycle == 1) bg1.fetchNameTable(column);
+    else if(Cycle == 2) bg2.fetchCharacter(column, 0);
+    else if(Cycle == 3) bg2.fetchCharacter(column, 1);
+    else if(Cycle == 4) bg1.fetchCharacter(column, 0);
+    else if(Cycle == 5) bg1.fetchCharacter(column, 1);
+    else if(Cycle == 6) bg1.fetchCharacter(column, 2);
+    else if(Cycle == 7) bg1.fetchCharacter(column, 3);
     break;
   case 4:
-    if(Cycle == 0) bg2.fetchNameTable();
-    else if(Cycle == 1) bg1.fetchNameTable();
-    else if(Cycle == 2) bg3.fetchOffset(0);
-    else if(Cycle == 3) bg2.fetchCharacter(0);
-    else if(Cycle == 4) bg1.fetchCharacter(0);
-    else if(Cycle == 5) bg1.fetchCharacter(1);
-    else if(Cycle == 6) bg1.fetchCharacter(2);
-    else if(Cycle == 7) bg1.fetchCharacter(3);
+    if(Cycle == 0) bg2.fetchNameTable(column);
+    else if(Cycle == 1) bg1.fetchNameTable(column);
+    else if(Cycle == 2) bg3.fetchOffset(column, 0);
+    else if(Cycle == 3) bg2.fetchCharacter(column, 0);
+    else if(Cycle == 4) bg1.fetchCharacter(column, 0);
+    else if(Cycle == 5) bg1.fetchCharacter(column, 1);
+    else if(Cycle == 6) bg1.fetchCharacter(column, 2);
+    else if(Cycle == 7) bg1.fetchCharacter(column, 3);
     break;
   case 5:
-    if(Cycle == 0) bg2.fetchNameTable();
-    else if(Cycle == 1) bg1.fetchNameTable();
-    else if(Cycle == 2) bg2.fetchCharacter(0, 0);
-    else if(Cycle == 3) bg2.fetchCharacter(0, 1);
-    else if(Cycle == 4) bg1.fetchCharacter(0, 0);
-    else if(Cycle == 5) bg1.fetchCharacter(1, 0);
-    else if(Cycle == 6) bg1.fetchCharacter(0, 1);
-    else if(Cycle == 7) bg1.fetchCharacter(1, 1);
+    if(Cycle == 0) bg2.fetchNameTable(column);
+    else if(Cycle == 1) bg1.fetchNameTable(column);
+    else if(Cycle == 2) bg2.fetchCharacter(column, 0, 0);
+    else if(Cycle == 3) bg2.fetchCharacter(column, 0, 1);
+    else if(Cycle == 4) bg1.fetchCharacter(column, 0, 0);
+    else if(Cycle == 5) bg1.fetchCharacter(column, 1, 0);
+    else if(Cycle == 6) bg1.fetchCharacter(column, 0, 1);
+    else if(Cycle == 7) bg1.fetchCharacter(column, 1, 1);
     break;
   case 6:
-    if(Cycle == 0) bg2.fetchNameTable();
-    else if(Cycle == 1) bg1.fetchNameTable();
-    else if(Cycle == 2) bg3.fetchOffset(0);
-    else if(Cycle == 3) bg3.fetchOffset(8);
-    else if(Cycle == 4) bg1.fetchCharacter(0, 0);
-    else if(Cycle == 5) bg1.fetchCharacter(1, 0);
-    else if(Cycle == 6) bg1.fetchCharacter(0, 1);
-    else if(Cycle == 7) bg1.fetchCharacter(1, 1);
+    if(Cycle == 0) bg2.fetchNameTable(column);
+    else if(Cycle == 1) bg1.fetchNameTable(column);
+    else if(Cycle == 2) bg3.fetchOffset(column, 0);
+    else if(Cycle == 3) bg3.fetchOffset(column, 8);
+    else if(Cycle == 4) bg1.fetchCharacter(column, 0, 0);
+    else if(Cycle == 5) bg1.fetchCharacter(column, 1, 0);
+    else if(Cycle == 6) bg1.fetchCharacter(column, 0, 1);
+    else if(Cycle == 7) bg1.fetchCharacter(column, 1, 1);
     break;
   case 7:
     //handled separately by mode7.cpp
@@ -220,6 +251,19 @@ void PPU::cycleBackgroundAbove() {
 
 void PPU::cycleRenderPixel() {
   obj.run();
+
+  if(deferred) {
+    Line& line = lines[vcounter()];
+    unsigned x = (hcounter() - 56) >> 2;
+    line.bg1[x] = bg1.output;
+    line.bg2[x] = bg2.output;
+    line.bg3[x] = bg3.output;
+    line.bg4[x] = bg4.output;
+    line.obj[x] = obj.output;
+    captured = x + 1;
+    return;
+  }
+
   window.run();
   screen.run();
 }
@@ -230,14 +274,16 @@ void PPU::cycle() {
     cycleObjectEvaluate();
 
   if(Cycle >=  0 && Cycle <= 1054 && (Cycle -  0) % 4 == 0)
-    cycleBackgroundFetch<(Cycle - 0) / 4 & 7>();
+    cycleBackgroundFetch<(Cycle - 0) / 4 & 7>(hcounter() >> 5);
 
-  if(Cycle == 56)
+  //frames that are not drawn still fetch and evaluate, for their timing, but
+  //produce no pixels
+  if(Cycle == 56 && !system.skipVideo)
     cycleBackgroundBegin();
 
-  if(Cycle >= 56 && Cycle <= 1078 && (Cycle - 56) % 4 == 0)
+  if(Cycle >= 56 && Cycle <= 1078 && (Cycle - 56) % 4 == 0 && !system.skipVideo)
     cycleBackgroundBelow();
-  else if(Cycle >= 56 && Cycle <= 1078 && (Cycle - 56) % 4 == 2) {
+  else if(Cycle >= 56 && Cycle <= 1078 && (Cycle - 56) % 4 == 2 && !system.skipVideo) {
     cycleBackgroundAbove();
     cycleRenderPixel();
   }
@@ -245,6 +291,104 @@ void PPU::cycle() {
   step();
 }
 
+void PPU::renderLine() {
+  for(unsigned index = 0; index < 128; ++index) obj.evaluate(index);
+
+  if(vcounter() > 0 && vcounter() <= 232 && !system.skipVideo) {
+    for(unsigned column = 0; column < 33; ++column) {
+      cycleBackgroundFetch<0>(column);
+      cycleBackgroundFetch<1>(column);
+      cycleBackgroundFetch<2>(column);
+      cycleBackgroundFetch<3>(column);
+      cycleBackgroundFetch<4>(column);
+      cycleBackgroundFetch<5>(column);
+      cycleBackgroundFetch<6>(column);
+      cycleBackgroundFetch<7>(column);
+    }
+
+    Line& line = lines[vcounter()];
+    bg1.renderLine(line.bg1);
+    bg2.renderLine(line.bg2);
+    bg3.renderLine(line.bg3);
+    bg4.renderLine(line.bg4);
+    obj.renderLine(line.obj);
+    queueLine();
+  }
+
+  obj.fetch();
+}
+
+//capture the state Screen::run() would use for this line, then composite it
+void PPU::queueLine() {
+  Line& line = lines[vcounter()];
+  line.hires = io.pseudoHires || io.bgMode == 5 || io.bgMode == 6;
+  if(line.hires && !display.wide) widen();
+  line.wide = display.wide;
+
+  line.lineA = screen.lineA;
+  //only the last line of a progressive frame is copied below itself, see
+  //Screen::scanline()
+  line.lineB = screen.lineB != screen.lineA ? screen.lineB : nullptr;
+  line.brightness = io.displayBrightness;
+
+  line.blank = io.displayDisable || (!io.overscan && vcounter() >= 225);
+  line.directColor = screen.io.directColor && (io.bgMode == 3 || io.bgMode == 4 || io.bgMode == 7);
+
+  line.window = window.io;
+  line.screen = screen.io;
+  std::memcpy(line.cgram, screen.cgram, sizeof(line.cgram));
+
+  #if defined(HAVE_THREADS)
+  //the CGRAM address latch is only needed by mid-line accesses (see latchLine)
+  if(workers.size()) {
+    queued = true;
+    return workers.push(&line);
+  }
+  #endif
+
+  line.render();
+  latch.cgramAddress = line.cgramAddress;
+}
+
+//CGRAM accessed mid-line uses the address of the last color fetched. if the
+//line is being captured for the workers, the pixels so far are composited here
+//as Screen::run() would have done them and the rest of the line is rendered as
+//it runs. if it was already queued, the address is taken once it is rendered
+void PPU::latchLine() {
+  Line& line = lines[vcounter()];
+  #if defined(HAVE_THREADS)
+  if(queued) {
+    workers.wait();
+    latch.cgramAddress = line.cgramAddress;
+    queued = false;
+  }
+  #endif
+  if(!deferred) return;
+
+  auto bg1Output = bg1.output;
+  auto bg2Output = bg2.output;
+  auto bg3Output = bg3.output;
+  auto bg4Output = bg4.output;
+  auto objOutput = obj.output;
+
+  for(unsigned x = 0; x < captured; ++x) {
+    bg1.output = line.bg1[x];
+    bg2.output = line.bg2[x];
+    bg3.output = line.bg3[x];
+    bg4.output = line.bg4[x];
+    obj.output = line.obj[x];
+    window.run();
+    screen.run();
+  }
+
+  bg1.output = bg1Output;
+  bg2.output = bg2Output;
+  bg3.output = bg3Output;
+  bg4.output = bg4Output;
+  obj.output = objOutput;
+  deferred = false;
+}
+
 void PPU::latchCounters(unsigned hcounter, unsigned vcounter) {
   io.hcounter = hcounter;
   io.vcounter = vcounter;
@@ -279,6 +423,7 @@ void PPU::writeVRAM(bool byte, uint8_t data) {
   uint16_t address = addressVRAM();
   if(byte == 0) vram[address] = (vram[address] & 0xff00) | data << 0;
   if(byte == 1) vram[address] = (vram[address] & 0x00ff) | data << 8;
+  vram.written.mark(address & vram.mask);
 }
 
 uint8_t PPU::readOAM(uint16_t addr) {
@@ -295,7 +440,10 @@ uint8_t PPU::readCGRAM(bool byte, uint8_t addr) {
   if(!io.displayDisable
   && vcounter() > 0 && vcounter() < vdisp()
   && hcounter() >= 88 && hcounter() < 1096
-  ) addr = latch.cgramAddress;
+  ) {
+    latchLine();
+    addr = latch.cgramAddress;
+  }
   return byte ? (screen.cgram[addr] & 0x7f00) >> 8 : screen.cgram[addr] & 0xff;
 }
 
@@ -303,7 +451,10 @@ void PPU::writeCGRAM(uint8_t addr, uint16_t data) {
   if(!io.displayDisable
   && vcounter() > 0 && vcounter() < vdisp()
   && hcounter() >= 88 && hcounter() < 1096
-  ) addr = latch.cgramAddress;
+  ) {
+    latchLine();
+    addr = latch.cgramAddress;
+  }
   screen.cgram[addr] = data;
 }
 
@@ -1133,11 +1284,11 @@ void PPU::Background::begin() {
   for(uint16_t& data : tiles[0].data) data >>= pixelCounter << 1;
 }
 
-void PPU::Background::fetchNameTable() {
+void PPU::Background::fetchNameTable(unsigned column) {
   if(ppu.vcounter() == 0) return;
 
-  unsigned nameTableIndex = ppu.hcounter() >> 5 << hires();
-  int x = (ppu.hcounter() & ~31) >> 2;
+  unsigned nameTableIndex = column << hires();
+  int x = column << 3;
 
   unsigned hpixel = x << hires();
   unsigned vpixel = ppu.vcounter();
@@ -1229,10 +1380,10 @@ void PPU::Background::fetchNameTable() {
   }
 }
 
-void PPU::Background::fetchOffset(unsigned y) {
+void PPU::Background::fetchOffset(unsigned column, unsigned y) {
   if(ppu.vcounter() == 0) return;
 
-  unsigned characterIndex = ppu.hcounter() >> 5 << hires();
+  unsigned characterIndex = column << hires();
   unsigned x = characterIndex << 3;
 
   unsigned hoffset = x + (io.hoffset & ~7);
@@ -1256,10 +1407,10 @@ void PPU::Background::fetchOffset(unsigned y) {
   if(y == 8) opt.voffset = ppu.vram[address];
 }
 
-void PPU::Background::fetchCharacter(unsigned index, bool half) {
+void PPU::Background::fetchCharacter(unsigned column, unsigned index, bool half) {
   if(ppu.vcounter() == 0) return;
 
-  unsigned characterIndex = (ppu.hcounter() >> 5 << hires()) + half;
+  unsigned characterIndex = (column << hires()) + half;
 
   Tile& tile = tiles[characterIndex];
   uint16_t data = ppu.vram[tile.address + (index << 3)];
@@ -1331,6 +1482,84 @@ void PPU::Background::run(bool pos) {
   if(!hires() || pos == Screen::Below) if(io.belowEnable) output.below = pixel;
 }
 
+//produces the same pixels as run() would over the whole scanline
+void PPU::Background::renderLine(Output *line) {
+  if(io.mode == Mode::Inactive) {
+    for(unsigned x = 0; x < 256; ++x) line[x].above.priority = line[x].below.priority = 0;
+    return;
+  }
+
+  if(io.mode == Mode::Mode7) {
+    for(unsigned x = 0; x < 256; ++x) {
+      output.above.priority = 0;
+      output.below.priority = 0;
+      runMode7();
+      line[x] = output;
+    }
+    return;
+  }
+
+  begin();
+
+  bool hires = this->hires();
+  unsigned index = renderingIndex;
+  unsigned counter = pixelCounter;
+  uint16_t mosaicCounter = mosaic.hcounter;
+  Pixel mosaicPixel = mosaic.pixel;
+
+  for(unsigned x = 0; x < 256; ++x) {
+    Output& out = line[x];
+    out.above.priority = 0;
+    out.below.priority = 0;
+
+    //in hires modes, the below screen receives the first pixel of each dot
+    for(unsigned n = 0; n <= hires; ++n) {
+      bool primary = hires && n == 0;
+
+      Tile& tile = tiles[index];
+      unsigned color = (tile.data[0] & 3) << 0;
+
+      if(io.mode >= Mode::BPP4)
+        color |= (tile.data[1] & 3) << 2;
+
+      if(io.mode >= Mode::BPP8) {
+        color |= (tile.data[2] & 3) << 4;
+        color |= (tile.data[3] & 3) << 6;
+      }
+
+      tile.data[0] >>= 2;
+      tile.data[1] >>= 2;
+      tile.data[2] >>= 2;
+      tile.data[3] >>= 2;
+
+      Pixel pixel;
+      pixel.priority = tile.priority;
+      pixel.palette = color ? (unsigned)(tile.palette + color) : 0;
+      pixel.paletteGroup = tile.paletteGroup;
+
+      counter = (counter + 1) & 7;
+      if(!counter) index = (index + 1) & 0x7f;
+
+      if((!hires || primary) && (x == 0 || --mosaicCounter == 0)) {
+        mosaicCounter = ppu.mosaic.size;
+        mosaicPixel = pixel;
+      } else if(mosaic.enable) {
+        pixel = mosaicPixel;
+      }
+
+      if(pixel.palette == 0) continue;
+
+      if(!primary && io.aboveEnable) out.above = pixel;
+      if((!hires || primary) && io.belowEnable) out.below = pixel;
+    }
+  }
+
+  renderingIndex = index;
+  pixelCounter = counter;
+  mosaic.hcounter = mosaicCounter;
+  mosaic.pixel = mosaicPixel;
+}
+
 void PPU::Background::power() {
   io = {};
   io.tiledataAddress = (random() & 0x0f) << 12;
@@ -1510,6 +1739,43 @@ void PPU::Object::run() {
   }
 }
 
+//produces the same pixels as run() would over the whole scanline
+void PPU::Object::renderLine(Output *line) {
+  for(unsigned x = 0; x < 256; ++x) line[x].above.priority = line[x].below.priority = 0;
+
+  auto oamTile = t.tile[!t.active];
+
+  for(unsigned n = 0; n < 34; ++n) {
+    const auto& tile = oamTile[n];
+    if(!tile.valid) break;
+
+    int sx = signextend<int16_t,9>(tile.x);
+    uint8_t priority = io.priority[tile.priority];
+
+    for(unsigned px = 0; px < 8; ++px) {
+      int x = sx + (int)px;
+      if(x < 0 || x > 255) continue;
+
+      unsigned color = 0, shift = tile.hflip ? px : 7 - px;
+      color += tile.data >> (shift +  0) & 1;
+      color += tile.data >> (shift +  7) & 2;
+      color += tile.data >> (shift + 14) & 4;
+      color += tile.data >> (shift + 21) & 8;
+      if(!color) continue;
+
+      if(io.aboveEnable) {
+        line[x].above.palette = tile.palette + color;
+        line[x].above.priority = priority;
+      }
+
+      if(io.belowEnable) {
+        line[x].below.palette = tile.palette + color;
+        line[x].below.priority = priority;
+      }
+    }
+  }
+}
+
 void PPU::Object::fetch() {
   auto oamItem = t.item[t.active];
   auto oamTile = t.tile[t.active];
@@ -1751,9 +2017,13 @@ void PPU::Window::power() {
 void PPU::Screen::scanline() {
   uint8_t y = ppu.vcounter() + (!ppu.display.overscan ? 7 : 0);
 
-  lineA = ppu.output + y * (ppu.display.interlace ? 1024 : 512);
-  lineB = lineA + (ppu.display.interlace ? 0 : 512);
-  if(ppu.display.interlace && ppu.field()) lineA += 512, lineB += 512;
+  unsigned pitch = 512 * ppu.pixelBytes;
+  lineA = ppu.output + y * (ppu.display.interlace ? pitch << 1 : pitch);
+  if(ppu.display.interlace && ppu.field()) lineA += pitch;
+  //in progressive mode, the copy of a line made below it is overwritten by the
+  //next line, so it is only written for the last line of the frame
+  bool lastLine = ppu.vcounter() == ppu.vdisp() - 1 || ppu.vcounter() == 232;
+  lineB = !ppu.display.interlace && lastLine ? lineA + pitch : lineA;
 
   //the first hires pixel of each scanline is transparent
   //note: exact value initializations are not confirmed on hardware
@@ -1775,8 +2045,38 @@ void PPU::Screen::run() {
   unsigned belowColor = below(hires);
   unsigned aboveColor = above();
 
-  *lineA++ = *lineB++ = ppu.lightTable[ppu.io.displayBrightness][hires ? belowColor : aboveColor];
-  *lineA++ = *lineB++ = ppu.lightTable[ppu.io.displayBrightness][aboveColor];
+  if(hires && !ppu.display.wide) ppu.widen();
+
+  uint32_t pixelB = ppu.lightTable[ColorMath::brightness(aboveColor, ppu.io.displayBrightness)];
+  if(!ppu.display.wide) {
+    //without hires, both halves of the dot are the above color
+    if(ppu.pixelBytes == 4) {
+      *(uint32_t*)lineA = pixelB;
+      if(lineB != lineA) *(uint32_t*)lineB = pixelB;
+    } else {
+      *(uint16_t*)lineA = pixelB;
+      if(lineB != lineA) *(uint16_t*)lineB = pixelB;
+    }
+    lineA += ppu.pixelBytes;
+    lineB += ppu.pixelBytes;
+    return;
+  }
+
+  uint32_t pixelA = ppu.lightTable[ColorMath::brightness(hires ? belowColor : aboveColor, ppu.io.displayBrightness)];
+
+  if(ppu.pixelBytes == 4) {
+    auto a = (uint32_t*)lineA, b = (uint32_t*)lineB;
+    a[0] = pixelA;
+    a[1] = pixelB;
+    if(b != a) b[0] = pixelA, b[1] = pixelB;
+  } else {
+    auto a = (uint16_t*)lineA, b = (uint16_t*)lineB;
+    a[0] = pixelA;
+    a[1] = pixelB;
+    if(b != a) b[0] = pixelA, b[1] = pixelB;
+  }
+  lineA += ppu.pixelBytes << 1;
+  lineB += ppu.pixelBytes << 1;
 }
 
 unsigned PPU::Screen::below(bool hires) {
@@ -1812,9 +2112,10 @@ unsigned PPU::Screen::below(bool hires) {
   if(!hires) return 0;
   if(!math.below.colorEnable) return math.above.colorEnable ? math.below.color : (unsigned)0;
 
-  return blend(
+  return ColorMath::blend(
     math.above.colorEnable ? math.below.color : (unsigned)0,
-    math.blendMode ? math.above.color : fixedColor()
+    math.blendMode ? math.above.color : fixedColor(),
+    io.colorMode, math.colorHalve
   );
 }
 
@@ -1868,38 +2169,19 @@ unsigned PPU::Screen::above() {
     math.colorHalve = io.colorHalve && math.above.colorEnable;
   }
 
-  return blend(
+  return ColorMath::blend(
     math.above.colorEnable ? math.above.color : (uint16_t)0,
-    math.blendMode ? math.below.color : fixedColor()
+    math.blendMode ? math.below.color : fixedColor(),
+    io.colorMode, math.colorHalve
   );
 }
 
-unsigned PPU::Screen::blend(unsigned x, unsigned y) const {
-  if(!io.colorMode) {  //add
-    if(!math.colorHalve) {
-      unsigned sum = x + y;
-      unsigned carry = (sum - ((x ^ y) & 0x0421)) & 0x8420;
-      return (sum - carry) | (carry - (carry >> 5));
-    } else {
-      return (x + y - ((x ^ y) & 0x0421)) >> 1;
-    }
-  } else {  //sub
-    unsigned diff = x - y + 0x8420;
-    unsigned borrow = (diff - ((x ^ y) & 0x8420)) & 0x8420;
-    if(!math.colorHalve) {
-      return   (diff - borrow) & (borrow - (borrow >> 5));
-    } else {
-      return (((diff - borrow) & (borrow - (borrow >> 5))) & 0x7bde) >> 1;
-    }
-  }
-}
-
 unsigned PPU::Screen::paletteColor(uint8_t palette) const {
   ppu.latch.cgramAddress = palette;
   return cgram[palette];
 }
 
-unsigned PPU::Screen::directColor(uint8_t palette, uint8_t paletteGroup) const {
+unsigned PPU::Screen::directColor(uint8_t palette, uint8_t paletteGroup) {
   //palette = -------- BBGGGRRR
   //group   = -------- -----bgr
   //output  = 0BBb00GG Gg0RRRr0
@@ -1931,6 +2213,251 @@ void PPU::Screen::power() {
   io.colorRed = random() & 0x1f;
 }
 
+//composites the line as Window::run() and Screen::run() would: the layers and
+//windows are resolved to color math operands one pixel at a time, then the
+//color math and brightness are applied to the whole line at once
+void PPU::Line::render() {
+  cgramAddress = 0;
+  math.above.color = paletteColor(0);
+  math.below.color = math.above.color;
+  math.above.colorEnable = 0;
+  math.below.colorEnable = 0;
+  math.transparent = 1;
+  math.blendMode   = 0;
+  math.colorHalve  = 0;
+
+  if(blank) {
+    uint16_t black[512] = {};
+    if(ppu.pixelBytes == 4) write<uint32_t>(black);
+    else write<uint16_t>(black);
+    return;
+  }
+
+  //in hires, even pixels come from the below screen and odd from the above
+  uint16_t x1[512], x2[512], halve[512], color[512];
+
+  for(unsigned x = 0; x < 256; ++x) {
+    bool one = (x >= window.oneLeft && x <= window.oneRight);
+    bool two = (x >= window.twoLeft && x <= window.twoRight);
+
+    mask(window.bg1, one, two, bg1[x]);
+    mask(window.bg2, one, two, bg2[x]);
+    mask(window.bg3, one, two, bg3[x]);
+    mask(window.bg4, one, two, bg4[x]);
+    mask(window.obj, one, two, obj[x]);
+
+    bool value = Window::test(window.col.oneEnable, one ^ window.col.oneInvert, window.col.twoEnable, two ^ window.col.twoInvert, window.col.mask);
+    bool array[] = {true, value, !value, false};
+
+    unsigned n = hires ? x << 1 : x;
+    below(x, x1[n], x2[n], halve[n]);
+    n += hires;
+    above(x, array[window.col.aboveMask], array[window.col.belowMask], x1[n], x2[n], halve[n]);
+  }
+
+  unsigned count = hires ? 512 : 256;
+  ColorMath::blend(color, x1, x2, halve, count, screen.colorMode);
+  if(brightness != 15) ColorMath::brightness(color, color, count, brightness);
+
+  if(ppu.pixelBytes == 4) write<uint32_t>(color);
+  else write<uint16_t>(color);
+}
+
+//converts the composited colors to the output format, doubling them if the
+//frame is wide but this line is not hires
+template<typename Pixel>
+void PPU::Line::write(const uint16_t *color) {
+  auto output = (Pixel*)lineA;
+
+  if(hires || !wide) {
+    unsigned width = hires ? 512 : 256;
+    for(unsigned n = 0; n < width; ++n) *output++ = ppu.lightTable[color[n]];
+  } else {
+    for(unsigned n = 0; n < 256; ++n) {
+      Pixel pixel = ppu.lightTable[color[n]];
+      *output++ = pixel;
+      *output++ = pixel;
+    }
+  }
+
+  unsigned width = wide ? 512 : 256;
+  ppu.hashLine(lineA, width);
+  if(lineB) {
+    std::memcpy(lineB, lineA, width * sizeof(Pixel));
+    ppu.hashLine(lineB, width);
+  }
+}
+
+template<typename Output>
+void PPU::Line::mask(const Window::IO::Layer& layer, bool one, bool two, Output& output) {
+  if(Window::test(layer.oneEnable, one ^ layer.oneInvert, layer.twoEnable, two ^ layer.twoInvert, layer.mask)) {
+    if(layer.aboveEnable) output.above.priority = 0;
+    if(layer.belowEnable) output.below.priority = 0;
+  }
+}
+
+void PPU::Line::below(unsigned x, uint16_t& x1, uint16_t& x2, uint16_t& halve) {
+  unsigned priority = 0;
+  if(bg1[x].below.priority) {
+    priority = bg1[x].below.priority;
+    if(directColor) {
+      math.below.color = Screen::directColor(bg1[x].below.palette, bg1[x].below.paletteGroup);
+    } else {
+      math.below.color = paletteColor(bg1[x].below.palette);
+    }
+  }
+  if(bg2[x].below.priority > priority) {
+    priority = bg2[x].below.priority;
+    math.below.color = paletteColor(bg2[x].below.palette);
+  }
+  if(bg3[x].below.priority > priority) {
+    priority = bg3[x].below.priority;
+    math.below.color = paletteColor(bg3[x].below.palette);
+  }
+  if(bg4[x].below.priority > priority) {
+    priority = bg4[x].below.priority;
+    math.below.color = paletteColor(bg4[x].below.palette);
+  }
+  if(obj[x].below.priority > priority) {
+    priority = obj[x].below.priority;
+    math.below.color = paletteColor(obj[x].below.palette);
+  }
+  if((math.transparent = (priority == 0))) math.below.color = paletteColor(0);
+
+  if(!hires) return;
+
+  //pixels without color math are blended with zero, which leaves them as-is
+  x1 = math.above.colorEnable ? math.below.color : 0;
+  if(!math.below.colorEnable) {
+    x2 = 0;
+    halve = 0;
+    return;
+  }
+
+  x2 = math.blendMode ? math.above.color : fixedColor();
+  halve = math.colorHalve ? 0xffff : 0;
+}
+
+void PPU::Line::above(unsigned x, bool aboveColorEnable, bool belowColorEnable, uint16_t& x1, uint16_t& x2, uint16_t& halve) {
+  unsigned priority = 0;
+  if(bg1[x].above.priority) {
+    priority = bg1[x].above.priority;
+    if(directColor) {
+      math.above.color = Screen::directColor(bg1[x].above.palette, bg1[x].above.paletteGroup);
+    } else {
+      math.above.color = paletteColor(bg1[x].above.palette);
+    }
+    math.below.colorEnable = screen.bg1.colorEnable;
+  }
+  if(bg2[x].above.priority > priority) {
+    priority = bg2[x].above.priority;
+    math.above.color = paletteColor(bg2[x].above.palette);
+    math.below.colorEnable = screen.bg2.colorEnable;
+  }
+  if(bg3[x].above.priority > priority) {
+    priority = bg3[x].above.priority;
+    math.above.color = paletteColor(bg3[x].above.palette);
+    math.below.colorEnable = screen.bg3.colorEnable;
+  }
+  if(bg4[x].above.priority > priority) {
+    priority = bg4[x].above.priority;
+    math.above.color = paletteColor(bg4[x].above.palette);
+    math.below.colorEnable = screen.bg4.colorEnable;
+  }
+  if(obj[x].above.priority > priority) {
+    priority = obj[x].above.priority;
+    math.above.color = paletteColor(obj[x].above.palette);
+    math.below.colorEnable = screen.obj.colorEnable && obj[x].above.palette >= 192;
+  }
+  if(priority == 0) {
+    math.above.color = paletteColor(0);
+    math.below.colorEnable = screen.back.colorEnable;
+  }
+
+  if(!belowColorEnable) math.below.colorEnable = 0;
+  math.above.colorEnable = aboveColorEnable;
+  x1 = math.above.colorEnable ? math.above.color : 0;
+  if(!math.below.colorEnable) {
+    x2 = 0;
+    halve = 0;
+    return;
+  }
+
+  if(screen.blendMode && math.transparent) {
+    math.blendMode  = 0;
+    math.colorHalve = 0;
+  } else {
+    math.blendMode  = screen.blendMode;
+    math.colorHalve = screen.colorHalve && math.above.colorEnable;
+  }
+
+  x2 = math.blendMode ? math.below.color : fixedColor();
+  halve = math.colorHalve ? 0xffff : 0;
+}
+
+unsigned PPU::Line::paletteColor(uint8_t palette) {
+  cgramAddress = palette;
+  return cgram[palette];
+}
+
+unsigned PPU::Line::fixedColor() const {
+  return screen.colorBlue << 10 | screen.colorGreen << 5 | screen.colorRed << 0;
+}
+
+#if defined(HAVE_THREADS)
+PPU::Workers::~Workers() {
+  resize(0);
+}
+
+void PPU::Workers::resize(unsigned count) {
+  wait();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    quit = true;
+  }
+  ready.notify_all();
+  for(std::thread& thread : threads) thread.join();
+  threads.clear();
+  quit = false;
+
+  for(unsigned n = 0; n < count; ++n) threads.emplace_back(&Workers::main, this);
+}
+
+void PPU::Workers::push(Line *line) {
+  if(pushed == 240) wait();
+
+  std::unique_lock<std::mutex> lock(mutex);
+  queue[pushed++] = line;
+
+  //waking the workers costs more than compositing a line, so lines are handed
+  //out in batches; wait() picks up the remainder at the end of the frame
+  if(pushed % 16 == 0) ready.notify_all();
+}
+
+void PPU::Workers::wait() {
+  std::unique_lock<std::mutex> lock(mutex);
+  if(taken < pushed) ready.notify_all();
+  done.wait(lock, [&] { return finished == pushed; });
+  pushed = taken = finished = 0;
+}
+
+void PPU::Workers::main() {
+  std::unique_lock<std::mutex> lock(mutex);
+  while(true) {
+    ready.wait(lock, [&] { return quit || taken < pushed; });
+    if(quit) return;
+
+    Line *line = queue[taken++];
+    lock.unlock();
+    line->render();
+    lock.lock();
+
+    if(++finished == pushed) done.notify_all();
+  }
+}
+#endif
+
 void PPU::serialize(serializer& s) {
   s.integer(display.interlace);
   s.integer(display.overscan);
@@ -1938,9 +2465,10 @@ void PPU::serialize(serializer& s) {
 
   Thread::serialize(s);
   PPUcounter::serialize(s);
+  s.integer(idle);
 
   s.integer(vram.mask);
-  s.array(vram.data, vram.mask + 1);
+  s.array(vram.data, vram.mask + 1, vram.written);
 
   s.integer(ppu1.version);
   s.integer(ppu1.mdr);
@@ -2249,42 +2777,71 @@ unsigned PPUcounter::hdot() const {
   }
 }
 
-void PPU::setBuffer(uint32_t *buffer) {
-  output = buffer;
+void PPU::setBuffer(void *buffer) {
+  #if defined(HAVE_THREADS)
+  workers.wait();
+  #endif
+
+  output = (uint8_t*)buffer;
+  invalidateLines();
+}
+
+void PPU::setPixelFormat(PixelFormat format) {
+  if(format == pixelFormat) return;
+
+  #if defined(HAVE_THREADS)
+  workers.wait();
+  #endif
+
+  pixelFormat = format;
+  pixelBytes = format == PixelFormat::XRGB8888 ? 4 : 2;
+  invalidateLines();
+  genPalette(palette.luminance, palette.saturation, palette.gamma);
 }
 
 void PPU::genPalette(double luminance, double saturation, double gamma) {
+  #if defined(HAVE_THREADS)
+  workers.wait();
+  #endif
+
+  palette.luminance = luminance;
+  palette.saturation = saturation;
+  palette.gamma = gamma;
+
   double reciprocal = 1.0 / 32767.0;
   double inverse = std::max(0.0, 1.0 - saturation);
 
-  for(unsigned l = 0; l < 16; ++l) {
-    for(unsigned r = 0; r < 32; ++r) {
-      for(unsigned g = 0; g < 32; ++g) {
-        for(unsigned b = 0; b < 32; ++b) {
-          double luma = (double)l / 15.0;
-          unsigned ar = (luma * r + 0.5);
-          unsigned ag = (luma * g + 0.5);
-          unsigned ab = (luma * b + 0.5);
-
-          ar = ar << 3 | ar >> 2; ar = ar << 8 | ar << 0;
-          ag = ag << 3 | ag >> 2; ag = ag << 8 | ag << 0;
-          ab = ab << 3 | ab >> 2; ab = ab << 8 | ab << 0;
-
-          unsigned grayscale = std::min((ar + ag + ab) / 3, (unsigned)65535);
-          ar = std::min(ar * saturation + grayscale * inverse, 65535.0);
-          ag = std::min(ag * saturation + grayscale * inverse, 65535.0);
-          ab = std::min(ab * saturation + grayscale * inverse, 65535.0);
-
-          ar = ar > 32767 ? ar : uint16_t(32767 * pow(ar * reciprocal, gamma));
-          ag = ag > 32767 ? ag : uint16_t(32767 * pow(ag * reciprocal, gamma));
-          ab = ab > 32767 ? ab : uint16_t(32767 * pow(ab * reciprocal, gamma));
-
-          ar = std::min(ar * luminance, 65535.0);
-          ag = std::min(ag * luminance, 65535.0);
-          ab = std::min(ab * luminance, 65535.0);
-
-          lightTable[l][(r << 10) + (g << 5) + b] =
-            ab >> 8 << 16 | ag >> 8 <<  8 | ar >> 8 << 0;
+  for(unsigned r = 0; r < 32; ++r) {
+    for(unsigned g = 0; g < 32; ++g) {
+      for(unsigned b = 0; b < 32; ++b) {
+        unsigned ar = r << 3 | r >> 2; ar = ar << 8 | ar << 0;
+        unsigned ag = g << 3 | g >> 2; ag = ag << 8 | ag << 0;
+        unsigned ab = b << 3 | b >> 2; ab = ab << 8 | ab << 0;
+
+        unsigned grayscale = std::min((ar + ag + ab) / 3, (unsigned)65535);
+        ar = std::min(ar * saturation + grayscale * inverse, 65535.0);
+        ag = std::min(ag * saturation + grayscale * inverse, 65535.0);
+        ab = std::min(ab * saturation + grayscale * inverse, 65535.0);
+
+        ar = ar > 32767 ? ar : uint16_t(32767 * pow(ar * reciprocal, gamma));
+        ag = ag > 32767 ? ag : uint16_t(32767 * pow(ag * reciprocal, gamma));
+        ab = ab > 32767 ? ab : uint16_t(32767 * pow(ab * reciprocal, gamma));
+
+        ar = std::min(ar * luminance, 65535.0);
+        ag = std::min(ag * luminance, 65535.0);
+        ab = std::min(ab * luminance, 65535.0);
+
+        uint32_t& pixel = lightTable[(r << 10) + (g << 5) + b];
+        switch(pixelFormat) {
+        case PixelFormat::XRGB1555:
+          pixel = ab >> 11 << 10 | ag >> 11 << 5 | ar >> 11 << 0;
+          break;
+        case PixelFormat::RGB565:
+          pixel = ab >> 11 << 11 | ag >> 10 << 5 | ar >> 11 << 0;
+          break;
+        default:
+          pixel = ab >> 8 << 16 | ag >> 8 <<  8 | ar >> 8 << 0;
+          break;
         }
       }
     }
@@ -2320,14 +2877,27 @@ void PPU::step() {
 }
 
 void PPU::step(unsigned clocks) {
-  clocks >>= 1;
-  while(clocks--) {
+  idle = clocks >> 1;
+  while(idle) {
+    --idle;
     tick(2);
     clock += 2;
     synchronizeCPU();
   }
 }
 
+//while the PPU is only stepping through idle clocks, nothing it does depends on
+//the other threads: they may advance it up to the present in place, rather than
+//switching to the PPU thread only for it to count clocks and switch back.
+bool PPU::skipIdle() {
+  while(idle && clock < 0) {
+    --idle;
+    tick(2);
+    clock += 2;
+  }
+  return clock >= 0;
+}
+
 [[noreturn]] static void Enter() {
   while(true) {
     scheduler.synchronize();
@@ -2344,6 +2914,10 @@ bool PPU::load() {
 }
 
 void PPU::power(bool reset) {
+  #if defined(HAVE_THREADS)
+  workers.wait();
+  #endif
+
   create(Enter, system.cpuFrequency());
   PPUcounter::reset();
 
@@ -2352,6 +2926,7 @@ void PPU::power(bool reset) {
   bus.map(reader, writer, "00-3f,80-bf:2100-213f");
 
   if(!reset) random.array((uint8_t*)vram.data, sizeof(vram.data));
+  vram.written.resize(64 * 1024);
 
   ppu1.mdr = random.bias(0xff);
   ppu2.mdr = random.bias(0xff);
@@ -2451,11 +3026,88 @@ void PPU::power(bool reset) {
   updateVideoMode();
 }
 
+//progressive frames start out 256 pixels wide, and the first hires line
+//doubles the pixels of every line drawn before it so the frame is 512 wide
+void PPU::widen() {
+  #if defined(HAVE_THREADS)
+  workers.wait();
+  #endif
+
+  if(pixelBytes == 4) widen<uint32_t>();
+  else widen<uint16_t>();
+  display.wide = true;
+  invalidateLines();
+
+  //move the cycle renderer to the same dot in the widened line
+  unsigned pitch = 512 * pixelBytes;
+  unsigned offsetA = screen.lineA - output;
+  unsigned offsetB = screen.lineB - output;
+  screen.lineA = output + offsetA / pitch * pitch + offsetA % pitch * 2;
+  screen.lineB = output + offsetB / pitch * pitch + offsetB % pitch * 2;
+}
+
+template<typename Pixel>
+void PPU::widen() {
+  for(unsigned y = 0; y < 240; ++y) {
+    Pixel *line = (Pixel*)output + y * 512;
+    for(unsigned x = 256; x-- > 0;) line[x << 1] = line[x << 1 | 1] = line[x];
+  }
+}
+
+//hashes a row of the output buffer once it has been drawn, noting whether it
+//changed; rows are only ever drawn by one thread at a time
+void PPU::hashLine(const uint8_t *line, unsigned width) {
+  unsigned y = (line - output) / (512 * pixelBytes);
+  if(y >= 480) return;
+
+  //four independent multiply chains, so this keeps pace with the writes
+  uint64_t hash[4] = {width, width + 1, width + 2, width + 3};
+  unsigned size = width * pixelBytes;
+  for(unsigned n = 0; n < size; n += 32) {
+    for(unsigned lane = 0; lane < 4; ++lane) {
+      uint64_t data;
+      std::memcpy(&data, line + n + lane * 8, sizeof(data));
+      hash[lane] = (hash[lane] ^ data) * 0x100000001b3ull;
+    }
+  }
+  uint64_t result = hash[0] ^ hash[1] << 1 ^ hash[2] << 2 ^ hash[3] << 3;
+
+  if(lineHash[y] != result) {
+    lineHash[y] = result;
+    lineChanged[y] = true;
+  }
+}
+
+//used when the contents of the buffer change other than by drawing a row
+void PPU::invalidateLines() {
+  for(unsigned y = 0; y < 480; ++y) lineHash[y] = 0;
+  linesInvalid = true;
+}
+
 void PPU::refresh() {
-  if(system.runAhead) return;
+  #if defined(HAVE_THREADS)
+  workers.wait();
+  #endif
+
+  if(system.runAhead || system.skipVideo) return;
   unsigned pitch  = 512;
-  unsigned width  = 512;
+  unsigned width  = display.wide ? 512 : 256;
   unsigned height = ppu.display.interlace ? 480 : 240;
+
+  if(width != sentWidth || height != sentHeight) linesInvalid = true;
+  sentWidth = width;
+  sentHeight = height;
+
+  std::memset(dirty.lines, 0, sizeof(dirty.lines));
+  dirty.frame = false;
+  for(unsigned y = 0; y < height; ++y) {
+    if(!lineChanged[y] && !linesInvalid) continue;
+    dirty.lines[y >> 3] |= 1 << (y & 7);
+    dirty.frame = true;
+  }
+  std::memset(lineChanged, 0, sizeof(lineChanged));
+  linesInvalid = false;
+
   videoFrame(udata, width, height, pitch);
 }
 
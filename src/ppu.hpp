@@ -20,6 +20,13 @@
 
 #pragma once
 
+#if defined(HAVE_THREADS)
+  #include <condition_variable>
+  #include <mutex>
+  #include <thread>
+  #include <vector>
+#endif
+
 #include "function.hpp"
 #include "sfc.hpp"
 #include "system.hpp"
@@ -94,30 +101,44 @@ struct PPU : Thread, PPUcounter {
   void (*videoFrame)(const void*, unsigned, unsigned, unsigned);
 
   alwaysinline void synchronizeCPU();
+  bool skipIdle();
   bool load();
   void power(bool);
 
   alwaysinline void main();
   void cycleObjectEvaluate();
-  template<unsigned Cycle> void cycleBackgroundFetch();
+  template<unsigned Cycle> void cycleBackgroundFetch(unsigned);
   void cycleBackgroundBegin();
   void cycleBackgroundBelow();
   void cycleBackgroundAbove();
   void cycleRenderPixel();
   template<unsigned> void cycle();
+  void renderLine();
+  void queueLine();
+  void latchLine();
 
   void latchCounters(unsigned, unsigned);
   void latchCounters();
 
   void serialize(serializer&);
 
-  void setBuffer(uint32_t*);
+  enum class PixelFormat : unsigned { XRGB8888, XRGB1555, RGB565 };
+
+  void setBuffer(void*);
+  void setPixelFormat(PixelFormat);
   void genPalette(double = 1.0, double = 1.0, double = 1.2);
 
+  //rows of the last frame sent which changed since the frame before it
+  struct Dirty {
+    uint8_t lines[480 / 8];  //bit (y & 7) of byte (y >> 3) for row y
+    bool frame;              //any row changed
+  } dirty;
+
   struct VRAM {
     uint16_t& operator[](unsigned);
     uint16_t data[64 * 1024];
     uint16_t mask = 0x7fff;
+    DirtyPages written;
   } vram;
 
   void *udata;
@@ -137,15 +158,40 @@ private:
   void writeIO(unsigned, uint8_t);
   void updateVideoMode();
 
-  uint32_t *output;
-  uint32_t lightTable[16][32768];
+  unsigned idle = 0;  //steps remaining in the current step(unsigned) call
+
+  uint8_t *output;
+  PixelFormat pixelFormat = PixelFormat::XRGB8888;
+  unsigned pixelBytes = 4;
+  uint32_t lightTable[32768];  //at full brightness, see ColorMath::brightness
+
+  struct {
+    double luminance = 1.0;
+    double saturation = 1.0;
+    double gamma = 1.2;
+  } palette;
 
   struct {
     bool interlace;
     bool overscan;
+    bool wide;  //lines of this frame are 512 pixels wide, else 256
     unsigned vdisp;
   } display;
 
+  void widen();
+  template<typename Pixel> void widen();
+
+  //per row of the output buffer: a hash of its contents when last drawn, and
+  //whether that differed from the hash before it since the last frame was sent
+  uint64_t lineHash[480];
+  bool lineChanged[480];
+  bool linesInvalid;  //the buffer changed under the hashes, report every row
+  unsigned sentWidth;
+  unsigned sentHeight;
+
+  void hashLine(const uint8_t*, unsigned);
+  void invalidateLines();
+
   void refresh();
 
   struct {
@@ -257,9 +303,9 @@ private:
 
     inline void scanline();
     void begin();
-    void fetchNameTable();
-    void fetchOffset(unsigned y);
-    void fetchCharacter(unsigned, bool = false);
+    void fetchNameTable(unsigned);
+    void fetchOffset(unsigned, unsigned y);
+    void fetchCharacter(unsigned, unsigned, bool = false);
     alwaysinline void run(bool);
     void power();
 
@@ -303,6 +349,8 @@ private:
       Pixel below;
     } output;
 
+    void renderLine(Output*);
+
     struct Mosaic {
       uint8_t enable;
       uint16_t hcounter;
@@ -419,12 +467,14 @@ private:
         uint8_t palette;
       } above, below;
     } output;
+
+    void renderLine(Output*);
   };
 
   struct Window {
     void scanline();
     void run();
-    inline bool test(bool, bool, bool, bool, unsigned);
+    static inline bool test(bool, bool, bool, bool, unsigned);
     void power();
 
     void serialize(serializer&);
@@ -473,15 +523,14 @@ private:
     unsigned below(bool hires);
     unsigned above();
 
-    unsigned blend(unsigned, unsigned) const;
     inline unsigned paletteColor(uint8_t) const;
-    inline unsigned directColor(uint8_t, uint8_t) const;
+    static inline unsigned directColor(uint8_t, uint8_t);
     inline unsigned fixedColor() const;
 
     void serialize(serializer&);
 
-    uint32_t *lineA;
-    uint32_t *lineB;
+    uint8_t *lineA;
+    uint8_t *lineB;
 
     uint16_t cgram[256];
 
@@ -520,6 +569,70 @@ private:
   Window window;
   Screen screen;
 
+  //the state needed to composite one scanline, captured once its background
+  //and object pixels are known so that it may be rendered on a host thread
+  struct Line {
+    void render();
+    template<typename Pixel> void write(const uint16_t*);
+
+    template<typename Output>
+    alwaysinline void mask(const Window::IO::Layer&, bool, bool, Output&);
+    void below(unsigned, uint16_t&, uint16_t&, uint16_t&);
+    void above(unsigned, bool, bool, uint16_t&, uint16_t&, uint16_t&);
+    alwaysinline unsigned paletteColor(uint8_t);
+    inline unsigned fixedColor() const;
+
+    uint8_t *lineA;
+    uint8_t *lineB;
+    uint8_t brightness;
+    bool blank;
+    bool hires;
+    bool wide;
+    bool directColor;
+    uint8_t cgramAddress;
+
+    Window::IO window;
+    Screen::IO screen;
+    Screen::Math math;
+    uint16_t cgram[256];
+
+    Background::Output bg1[256];
+    Background::Output bg2[256];
+    Background::Output bg3[256];
+    Background::Output bg4[256];
+    Object::Output obj[256];
+  } lines[240];
+
+  bool deferred = false;  //pixels of the current line are captured into lines[]
+  unsigned captured = 0;  //pixels captured so far
+  bool queued = false;    //the current line was handed to the workers
+
+#if defined(HAVE_THREADS)
+  //host threads which composite queued lines while emulation continues
+  struct Workers {
+    ~Workers();
+
+    void resize(unsigned);
+    void push(Line*);
+    void wait();
+    unsigned size() const { return threads.size(); }
+
+  private:
+    void main();
+
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::condition_variable done;
+
+    Line *queue[240];
+    unsigned pushed = 0;
+    unsigned taken = 0;
+    unsigned finished = 0;
+    bool quit = false;
+  } workers;
+#endif
+
   friend struct System;
 };
 
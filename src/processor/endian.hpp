@@ -15,6 +15,7 @@
     || defined(__AARCH64EL__) || defined(_MIPSEL) || defined(__MIPSEL) \
     || defined(__MIPSEL__) || defined(_WIN32) || defined(_WIN64)
   //little-endian: uint8_t[] { 0x01, 0x02, 0x03, 0x04 } == 0x04030201
+  #define ENDIAN_LSB                  1
   #define order_lsb2(a,b)             a,b
   #define order_lsb4(a,b,c,d)         a,b,c,d
 #elif (defined(__BYTE_ORDER) && __BYTE_ORDER == __BIG_ENDIAN) \
@@ -24,10 +25,12 @@
     || defined(__AARCH64EB__) || defined(_MIPSEB) || defined(__MIPSEB) \
     || defined(__MIPSEB__) || defined(__powerpc__) || defined(_M_PPC)
   //big-endian:    uint8_t[] { 0x01, 0x02, 0x03, 0x04 } == 0x01020304
+  #define ENDIAN_LSB                  0
   #define order_lsb2(a,b)             b,a
   #define order_lsb4(a,b,c,d)         d,c,b,a
 #else
   #warning "Endianness is unknown, assuming little endian."
+  #define ENDIAN_LSB                  1
   #define order_lsb2(a,b)             a,b
   #define order_lsb4(a,b,c,d)         a,b,c,d
 #endif
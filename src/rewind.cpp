@@ -0,0 +1,175 @@
+/*
+ * bsnes-jg - Super Nintendo emulator
+ *
+ * Copyright (C) 2004-2020 byuu
+ * Copyright (C) 2020-2022 Rupert Carmichael
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, specifically version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "serializer.hpp"
+#include "system.hpp"
+
+#include "rewind.hpp"
+
+namespace SuperFamicom {
+
+Rewind rewinder;
+
+//length of the history in seconds (0 disables it), and frames per state
+void Rewind::enable(unsigned seconds_, unsigned interval_) {
+  seconds = seconds_;
+  interval = std::max(interval_, 1U);
+  reset();
+  if(!seconds) {
+    std::vector<uint8_t>().swap(current);
+    std::vector<uint8_t>().swap(next);
+    nextUsed = 0;
+    std::vector<std::vector<uint8_t>>().swap(deltas);
+  }
+}
+
+void Rewind::reset() {
+  current.clear();
+  currentUsed = 0;
+  currentBase = 0;
+  nextBase = 0;
+  deltas.clear();
+  first = 0;
+  count = 0;
+  counter = 0;
+}
+
+//called before each frame is run, capturing a state every interval frames
+void Rewind::capture() {
+  if(!seconds) return;
+  if(current.size() && counter < interval) {
+    ++counter;
+    return;
+  }
+
+  //the buffer still holds the state from two captures ago, so only pages
+  //written since then are saved over it
+  unsigned capacity = system.serializeCapacity();
+  if(next.size() != capacity) {
+    next.assign(capacity, 0);
+    nextUsed = 0;
+  }
+  serializer s(next.data(), capacity, serializer::Save);
+  s.setBase(nextBase);
+  if(!system.serialize(s, false)) return;
+  uint64_t base = DirtyPages::advance();
+  if(s.size() < nextUsed) memset(next.data() + s.size(), 0, nextUsed - s.size());
+  nextUsed = s.size();
+
+  if(current.size() != next.size()) {
+    //first state: size the ring for the history length
+    reset();
+    unsigned rate = Region::PAL() ? 50 : 60;
+    deltas.resize(std::max(seconds * rate / interval, 1U));
+  } else {
+    if(count == deltas.size()) {
+      first = (first + 1) % deltas.size();  //drop the oldest state
+      --count;
+    }
+    std::vector<uint8_t>& delta = deltas[(first + count++) % deltas.size()];
+    encode(delta, next.data(), current.data(), std::max(nextUsed, currentUsed));
+  }
+
+  current.swap(next);
+  std::swap(currentUsed, nextUsed);
+  nextBase = currentBase;
+  currentBase = base;
+  counter = 1;
+}
+
+//restore the state to run the previous frame from, keeping the oldest one
+bool Rewind::step() {
+  if(current.empty()) return false;
+
+  //the newest state was captured for the frame just run, so skip past it
+  if(counter == 1 && count) {
+    decode(current.data(), deltas[(first + --count) % deltas.size()]);
+    currentBase = 0;
+    currentUsed = current.size();  //the older state's length is not known
+  }
+
+  serializer s(current.data(), current.size());
+  if(!system.unserialize(s)) return false;
+  counter = 1;
+  return true;
+}
+
+//XOR of two states as alternating runs: a count of zero bytes to skip, then a
+//count of bytes which differ followed by their XOR, both counts as LEB128
+static void putCount(std::vector<uint8_t>& out, unsigned n) {
+  while(n >= 0x80) {
+    out.push_back(n | 0x80);
+    n >>= 7;
+  }
+  out.push_back(n);
+}
+
+static unsigned getCount(const uint8_t*& p) {
+  unsigned n = 0;
+  for(unsigned shift = 0;; shift += 7) {
+    n |= (*p & 0x7f) << shift;
+    if(!(*p++ & 0x80)) return n;
+  }
+}
+
+void Rewind::encode(std::vector<uint8_t>& out, const uint8_t* a, const uint8_t* b, unsigned size) {
+  out.clear();
+  unsigned i = 0;
+  while(i < size) {
+    //skip equal bytes, a word at a time where possible
+    unsigned start = i;
+    while(i + 8 <= size) {
+      uint64_t x, y;
+      memcpy(&x, a + i, 8);
+      memcpy(&y, b + i, 8);
+      if(x != y) break;
+      i += 8;
+    }
+    while(i < size && a[i] == b[i]) ++i;
+    if(i == size) break;
+    putCount(out, i - start);
+
+    //differing bytes, until a run of four equal bytes or the end
+    start = i;
+    unsigned same = 0;
+    while(i < size && same < 4) {
+      same = a[i] == b[i] ? same + 1 : 0;
+      ++i;
+    }
+    if(same == 4) i -= 4;
+    putCount(out, i - start);
+    for(unsigned n = start; n < i; ++n) out.push_back(a[n] ^ b[n]);
+  }
+}
+
+void Rewind::decode(uint8_t* data, const std::vector<uint8_t>& delta) {
+  const uint8_t* p = delta.data();
+  const uint8_t* end = p + delta.size();
+  while(p < end) {
+    data += getCount(p);
+    unsigned length = getCount(p);
+    for(unsigned n = 0; n < length; ++n) *data++ ^= *p++;
+  }
+}
+
+}
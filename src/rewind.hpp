@@ -0,0 +1,64 @@
+/*
+ * bsnes-jg - Super Nintendo emulator
+ *
+ * Copyright (C) 2004-2020 byuu
+ * Copyright (C) 2020-2022 Rupert Carmichael
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, specifically version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace SuperFamicom {
+
+//history of deterministic states for rewinding. the newest state is kept
+//whole, and each older one as the compressed XOR of it and the state after
+//it, so stepping back costs one delta however long the history is
+struct Rewind {
+  void enable(unsigned, unsigned);
+  void reset();
+  void capture();
+  bool step();
+
+private:
+  static void encode(std::vector<uint8_t>&, const uint8_t*, const uint8_t*, unsigned);
+  static void decode(uint8_t*, const std::vector<uint8_t>&);
+
+  unsigned seconds = 0;
+  unsigned interval = 1;
+  unsigned counter = 0;  //frames run since the newest state was captured
+
+  //states vary in length with the threads' stacks, so the buffers are kept at
+  //full capacity, with the bytes past the length used by the state cleared
+  std::vector<uint8_t> current;  //the newest state, empty when there is none
+  std::vector<uint8_t> next;     //the state being captured
+  unsigned currentUsed = 0;
+  unsigned nextUsed = 0;
+
+  //epochs at which the buffers were saved, or 0 if they must be saved in full
+  uint64_t currentBase = 0;
+  uint64_t nextBase = 0;
+
+  //ring of deltas, oldest first; stored buffers are reused as it wraps
+  std::vector<std::vector<uint8_t>> deltas;
+  unsigned first = 0;
+  unsigned count = 0;
+};
+
+extern Rewind rewinder;
+
+}
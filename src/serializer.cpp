@@ -34,13 +34,20 @@ unsigned serializer::size() const {
   return _size;
 }
 
+unsigned serializer::capacity() const {
+  return _capacity;
+}
+
+//copies always own their data, even when the source wraps external memory
 serializer& serializer::operator=(const serializer& s) {
-  if(_data) delete[] _data;
+  if(_data && _owner) delete[] _data;
 
   _mode = s._mode;
   _data = new uint8_t[s._capacity];
   _size = s._size;
   _capacity = s._capacity;
+  _owner = true;
+  _base = s._base;
 
   memcpy(_data, s._data, s._capacity);
   return *this;
@@ -56,19 +63,40 @@ serializer::serializer(unsigned capacity) {
   _capacity = capacity;
 }
 
-serializer::serializer(const uint8_t* data, unsigned capacity) {
-  _mode = serializer::Load;
-  _data = new uint8_t[capacity];
+//load directly from the caller's memory; Load mode never writes to it
+serializer::serializer(const uint8_t* data, unsigned capacity)
+: serializer(const_cast<uint8_t*>(data), capacity, serializer::Load) {
+}
+
+//save to or load from the caller's memory in place, without copying it
+serializer::serializer(uint8_t* data, unsigned capacity, Mode mode) {
+  _mode = mode;
+  _data = data;
   _size = 0;
   _capacity = capacity;
-  memcpy(_data, data, capacity);
+  _owner = false;
 }
 
 serializer::~serializer() {
-  if(_data) delete[] _data;
+  if(_data && _owner) delete[] _data;
 }
 
 void serializer::setMode(Mode mode) {
   _mode = mode;
   _size = 0;
 }
+
+//saving over a buffer which holds a tracked state saved at the given epoch
+//leaves the pages of tracked memories not written since untouched, and
+//loading that state back leaves the same pages of the memories untouched
+void serializer::setBase(uint64_t base) {
+  _base = base;
+}
+
+uint64_t DirtyPages::epoch = 1;
+
+//states saved until now belong to the epoch returned, and writes from now on
+//to the next one
+uint64_t DirtyPages::advance() {
+  return epoch++;
+}
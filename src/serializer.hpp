@@ -30,12 +30,35 @@
 //caveats:
 //- only plain-old-data can be stored. complex classes must provide serialize(serializer&);
 //- floating-point usage is not portable across different implementations
+//- when constructed over existing memory, that memory must outlive the serializer
 
 #include <cstdint>
+#include <cstring>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+#include "processor/endian.hpp"
 
 struct serializer;
 
+//tracks writes to a memory by 256-entry page, recording the epoch in which each
+//page was last written. a tracked state saved at an epoch remains valid for the
+//pages not written since, so saving over it again only needs to copy the rest
+struct DirtyPages {
+  static uint64_t epoch;  //the current epoch, never 0
+  static uint64_t advance();
+
+  void resize(unsigned size) { pages.assign((size + 255) >> 8, epoch); }
+  void mark(unsigned address) { pages[address >> 8] = epoch; }
+  void markAll() { pages.assign(pages.size(), epoch); }
+  uint64_t* page(unsigned address) { return &pages[address >> 8]; }
+  bool written(unsigned page, uint64_t since) const { return pages[page] > since; }
+
+private:
+  std::vector<uint64_t> pages;
+};
+
 template<typename T>
 struct has_serialize {
   template<typename C> static char test(decltype(std::declval<C>().serialize(std::declval<serializer&>()))*);
@@ -49,8 +72,10 @@ struct serializer {
   Mode mode() const;
   const uint8_t* data() const;
   unsigned size() const;
+  unsigned capacity() const;
 
   void setMode(Mode);
+  void setBase(uint64_t);
 
   template<typename T> serializer& boolean(T& value) {
     if(_mode == Save) {
@@ -78,19 +103,35 @@ struct serializer {
   }
 
   template<typename T, int N> serializer& array(T (&_array)[N]) {
-    for(unsigned n = 0; n < N; ++n) operator()(_array[n]);
-    return *this;
+    return array(_array, N);
   }
 
   template<typename T> serializer& array(T _array, unsigned size) {
-    for(unsigned n = 0; n < size; ++n) operator()(_array[n]);
-    return *this;
+    return array(_array, size, std::integral_constant<bool, is_bulk<T>::value>());
   }
 
-  //optimized specializations
+  template<typename T, int N> serializer& array(T (&_array)[N], DirtyPages& pages) {
+    return array(_array, N, pages);
+  }
 
-  template<int N> serializer& array(uint8_t (&data)[N]) {
-    return array(data, N);
+  //a tracked memory: saving over a base state skips the pages it still holds,
+  //and loading a base state back only restores the pages written since. the
+  //pages loaded count as written, as do all of them on a load without a base
+  template<typename T> serializer& array(T _array, unsigned size, DirtyPages& pages) {
+    if(_mode == Size || !_base) {
+      array(_array, size);
+      if(_mode == Load) pages.markAll();
+      return *this;
+    }
+    for(unsigned n = 0; n < size; n += 256) {
+      unsigned count = size - n < 256 ? size - n : 256;
+      if(pages.written(n >> 8, _base)) {
+        array(_array + n, count);
+        if(_mode == Load) pages.mark(n);
+      }
+      else _size += count * sizeof(*_array);
+    }
+    return *this;
   }
 
   template<typename T> serializer& operator()(T& value, typename std::enable_if<has_serialize<T>::value>::type* = 0) {
@@ -107,11 +148,40 @@ struct serializer {
   serializer(const serializer&);
   serializer(unsigned);
   serializer(const uint8_t*, unsigned);
+  serializer(uint8_t*, unsigned, Mode);
   ~serializer();
 
 private:
+  //integer arrays already laid out as they are stored: bytes, and on
+  //little-endian hosts wider integers too. bool is excluded, as loading
+  //arbitrary bytes into it is not valid
+  template<typename T, typename E = typename std::remove_cv<
+    typename std::remove_pointer<T>::type>::type> struct is_bulk {
+    static const bool value = std::is_pointer<T>::value
+      && std::is_integral<E>::value && !std::is_same<bool, E>::value
+      && (sizeof(E) == 1 || ENDIAN_LSB);
+  };
+
+  template<typename T> serializer& array(T _array, unsigned size, std::false_type) {
+    for(unsigned n = 0; n < size; ++n) operator()(_array[n]);
+    return *this;
+  }
+
+  template<typename T> serializer& array(T _array, unsigned size, std::true_type) {
+    unsigned bytes = size * sizeof(*_array);
+    if(_mode == Save) {
+      memcpy(_data + _size, _array, bytes);
+    } else if(_mode == Load) {
+      memcpy(_array, _data + _size, bytes);
+    }
+    _size += bytes;
+    return *this;
+  }
+
   Mode _mode = Size;
   uint8_t* _data = nullptr;
   unsigned _size = 0;
   unsigned _capacity = 0;
+  bool _owner = true;  //false when wrapping memory provided by the caller
+  uint64_t _base = 0;  //epoch of the state already held in the buffer, if any
 };
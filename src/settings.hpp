@@ -70,6 +70,10 @@ struct Configuration {
 
   bool hotfixes = false;
   unsigned entropy = 1; // 0 = None, 1 = Low, 2 = High
+  bool fastPPU = false; // Render whole scanlines at once instead of per dot
+  unsigned renderThreads = 0; // Host threads compositing scanlines, 0 = none
+  unsigned frameSkip = 0; // Frames left undrawn after each one drawn
+  bool frameSkipAudio = true; // Output audio for frames left undrawn
 
   struct Coprocessor {
     bool delayedSync = true;
@@ -18,6 +18,7 @@
  * along with this program. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <cstdint>
 #include <cstring>
 
 #include "sfc.hpp"
@@ -26,20 +27,28 @@ namespace SuperFamicom {
 
 void Scheduler::enter() {
   host = co_active();
+  ++switches;
   co_switch(active);
 }
 
 void Scheduler::leave(Event event_) {
   event = event_;
   active = co_active();
+  ++switches;
   co_switch(host);
 }
 
 void Scheduler::resume(cothread_t thread) {
   if(mode == Mode::Synchronize) desynchronized = true;
+  ++switches;
   co_switch(thread);
 }
 
+void Scheduler::frame() {
+  frameSwitches = switches;
+  switches = 0;
+}
+
 void Thread::create(void (*entrypoint)(), unsigned frequency_) {
   if(!thread) {
     thread = co_create(Thread::Size, entrypoint);
@@ -64,27 +73,57 @@ void Thread::serialize(serializer& s) {
   s.integer(clock);
 }
 
-void Thread::serializeStack(serializer& s) {
-  static uint8_t stack[Thread::Size];
+//the stack pointer a suspended thread switched out with, for the libco
+//backends known to keep it in their context, else 0 (see libco.c)
+static uintptr_t savedStackPointer(cothread_t thread) {
+#if defined(__i386__) || defined(__amd64__) || defined(__aarch64__) \
+  || defined(_M_IX86) || defined(_M_AMD64)
+  return ((uintptr_t*)thread)[0];
+#elif defined(__arm__)
+  return ((unsigned long*)thread)[8];
+#elif defined(__riscv)
+  return *(uintptr_t*)((uint64_t*)thread + 1);
+#else
+  return 0;
+#endif
+}
+
+//the stack above sp in the buffer at base, rounded up so that it changes
+//rarely between states, keeping rewind deltas aligned. if sp is unknown or
+//outside the buffer, the whole stack
+static unsigned liveStack(uint8_t* base, uintptr_t sp) {
+  if(sp >= (uintptr_t)base + Thread::Context && sp <= (uintptr_t)base + Thread::Size)
+    return ((uintptr_t)base + Thread::Size - sp + 255) & ~255;
+  return Thread::Size - Thread::Context;
+}
+
+//only the context and the live part of the stack are stored, after its
+//length. the size allows for the whole buffer. a length which the stack
+//pointer in the stored context does not give fails the load before any of
+//the thread is overwritten
+bool Thread::serializeStack(serializer& s) {
+  uint8_t* base = (uint8_t*)thread;
   bool active = co_active() == thread;
+  unsigned live = Thread::Size - Thread::Context;
 
-  if(s.mode() == serializer::Size) {
-    s.array(stack, Thread::Size);
-    s.boolean(active);
-  }
+  if(s.mode() == serializer::Save && !active) live = liveStack(base, savedStackPointer(thread));
 
+  s.integer(live);
   if(s.mode() == serializer::Load) {
-    s.array(stack, Thread::Size);
-    s.boolean(active);
-    std::memcpy(thread, stack, Thread::Size);
-    if(active) scheduler.active = thread;
+    if(!live || live > Thread::Size - Thread::Context) return false;  //corrupt state
+    alignas(16) uint8_t context[Thread::Context];
+    s.array(context);
+    if(live != Thread::Size - Thread::Context && live != liveStack(base, savedStackPointer(context)))
+      return false;  //corrupt state
+    memcpy(base, context, Thread::Context);
+  } else {
+    s.array(base, Thread::Context);
   }
+  s.array(base + Thread::Size - live, live);
+  s.boolean(active);
 
-  if(s.mode() == serializer::Save) {
-    std::memcpy(stack, thread, Thread::Size);
-    s.array(stack, Thread::Size);
-    s.boolean(active);
-  }
+  if(s.mode() == serializer::Load && active) scheduler.active = thread;
+  return true;
 }
 
 }
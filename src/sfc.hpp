@@ -38,9 +38,13 @@ struct Scheduler {
   cothread_t active = nullptr;
   bool desynchronized = false;
 
+  unsigned switches = 0;       //context switches since the last frame event
+  unsigned frameSwitches = 0;  //context switches during the last complete frame
+
   void enter();
   void leave(Event);
   void resume(cothread_t);
+  void frame();
 
   inline bool synchronizing() const;
   inline void synchronize();
@@ -50,13 +54,15 @@ struct Scheduler {
 extern Scheduler scheduler;
 
 struct Thread {
-  enum : unsigned { Size = 4_KiB * sizeof(void*) };
+  //the libco context, at most 64 words in any backend, is kept at the start of
+  //the buffer and the stack grows down from the end
+  enum : unsigned { Size = 4_KiB * sizeof(void*), Context = 512 };
 
   void create(void (*entrypoint)(), unsigned);
   void destroy();
   bool active() const;
   void serialize(serializer&);
-  void serializeStack(serializer&);
+  bool serializeStack(serializer&);
 
   cothread_t thread = nullptr;
   uint32_t frequency = 0;
@@ -86,7 +86,10 @@ uint8_t SMP::readRAM(uint16_t address) {
 
 void SMP::writeRAM(uint16_t address, uint8_t data) {
   //writes to $ffc0-$ffff always go to apuram, even if the iplrom is enabled
-  if(io.ramWritable && !io.ramDisable) dsp.apuram[address] = data;
+  if(io.ramWritable && !io.ramDisable) {
+    dsp.apuram[address] = data;
+    dsp.apuramWritten.mark(address);
+  }
 }
 
 void SMP::idle() {
@@ -451,7 +454,7 @@ void SMP::synchronizeCPU() {
 }
 
 void SMP::synchronizeDSP() {
-  while(dsp.clock < 0) dsp.main();
+  if(dsp.clock < 0) dsp.main();
 }
 
 [[noreturn]] static void Enter() {
@@ -18,6 +18,7 @@
  * along with this program. If not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <cstring>
 
 #include "audio.hpp"
@@ -59,11 +60,14 @@ namespace SuperFamicom {
 System system;
 Scheduler scheduler;
 
-serializer System::serialize(bool synchronize) {
+//s must have room for serializeSize() bytes, usually as a view of the caller's
+//memory so that the state is written in place
+bool System::serialize(serializer& s, bool synchronize) {
   //deterministic serialization (synchronize=false) is only possible with select libco methods
   if(!co_serializable()) synchronize = true;
 
-  if(!information.serializeSize[synchronize]) return {};  //should never occur
+  if(!information.serializeSize[synchronize]) return false;  //should never occur
+  if(s.capacity() < information.serializeSize[synchronize]) return false;
   if(synchronize) runToSave();
 
   unsigned signature = 0x31545342;
@@ -73,7 +77,6 @@ serializer System::serialize(bool synchronize) {
   bool placeholder = false;
   std::memcpy(&version, (const char*)SerializerVersion.c_str(), SerializerVersion.size());
 
-  serializer s(serializeSize);
   s.integer(signature);
   s.integer(serializeSize);
   s.array(version);
@@ -81,7 +84,7 @@ serializer System::serialize(bool synchronize) {
   s.boolean(synchronize);
   s.boolean(placeholder);
   serializeAll(s, synchronize);
-  return s;
+  return true;
 }
 
 bool System::unserialize(serializer& s) {
@@ -101,11 +104,19 @@ bool System::unserialize(serializer& s) {
 
   if((signature != 0x31545342)
       || (serializeSize != information.serializeSize[synchronize])
+      || (serializeSize > s.capacity())
       || (std::string{version} != SerializerVersion))
     return false;
 
-  if(synchronize) power(/* reset = */ false);
-  serializeAll(s, synchronize);
+  if(synchronize) {
+    s.setBase(0);  //power may change memory without tracking it
+    power(/* reset = */ false);
+  }
+  if(!serializeAll(s, synchronize)) {
+    //the stacks loaded so far do not match the rest, so start over
+    power(/* reset = */ false);
+    return false;
+  }
   return true;
 }
 
@@ -113,9 +124,15 @@ unsigned System::serializeSize(bool synchronize) {
   return information.serializeSize[synchronize];
 }
 
+//room for a state of either kind, for buffers reused across many saves
+unsigned System::serializeCapacity() const {
+  return information.serializeCapacity;
+}
+
 //internal
 
-void System::serializeAll(serializer& s, bool synchronize) {
+//fails only when loading a corrupt cothread stack
+bool System::serializeAll(serializer& s, bool synchronize) {
   random.serialize(s);
   cartridge.serialize(s);
   cpu.serialize(s);
@@ -154,13 +171,14 @@ void System::serializeAll(serializer& s, bool synchronize) {
   expansionPort.serialize(s);
 
   if(!synchronize) {
-    cpu.serializeStack(s);
-    smp.serializeStack(s);
-    ppu.serializeStack(s);
+    if(!cpu.serializeStack(s)) return false;
+    if(!smp.serializeStack(s)) return false;
+    if(!ppu.serializeStack(s)) return false;
     for(Thread* coprocessor : cpu.coprocessors) {
-      coprocessor->serializeStack(s);
+      if(!coprocessor->serializeStack(s)) return false;
     }
   }
+  return true;
 }
 
 //perform dry-run state save:
@@ -185,10 +203,21 @@ unsigned System::serializeInit(bool synchronize) {
   return s.size();
 }
 
-void System::run() {
+void System::run(bool render) {
+  //with frame skipping, each frame drawn is followed by frameSkip that are not
+  if(render && configuration.frameSkip) {
+    render = frameCounter == 0;
+    frameCounter = frameCounter < configuration.frameSkip ? frameCounter + 1 : 0;
+  } else {
+    frameCounter = 0;
+  }
+  skipVideo = !render;
+  skipAudio = !render && !configuration.frameSkipAudio;
+
   scheduler.mode = Scheduler::Mode::Run;
   scheduler.enter();
   if(scheduler.event == Scheduler::Event::Frame) frameEvent();
+  dsp.flush();
 }
 
 void System::runToSave() {
@@ -275,6 +304,7 @@ void System::runToSaveSpecial() {
 
 
 void System::frameEvent() {
+  scheduler.frame();
   ppu.refresh();
 
   //refresh all cheat codes once per frame
@@ -435,6 +465,7 @@ void System::power(bool reset) {
 
   information.serializeSize[0] = serializeInit(0);
   information.serializeSize[1] = serializeInit(1);
+  information.serializeCapacity = std::max(information.serializeSize[0], information.serializeSize[1]);
 }
 
 }
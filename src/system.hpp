@@ -38,7 +38,7 @@ struct System {
   inline double cpuFrequency() const;
   inline double apuFrequency() const;
 
-  void run();
+  void run(bool = true);
   void runToSave();
   void runToSaveNormal();
   void runToSaveSpecial();
@@ -50,10 +50,13 @@ struct System {
   void power(bool);
 
   unsigned serializeSize(bool);
-  serializer serialize(bool);
+  unsigned serializeCapacity() const;
+  bool serialize(serializer&, bool);
   bool unserialize(serializer&);
 
   bool runAhead = false;
+  bool skipVideo = false;  //the frame being run is not drawn
+  bool skipAudio = false;  //nor is its audio output
 
 private:
   struct Information {
@@ -62,12 +65,14 @@ private:
     double cpuFrequency = FREQ_NTSC * 6.0;
     double apuFrequency = 32040.0 * 768.0;
     unsigned serializeSize[2] = {0, 0};
+    unsigned serializeCapacity = 0;  //the larger of the two
   } information;
 
-  void serializeAll(serializer&, bool);
+  bool serializeAll(serializer&, bool);
   unsigned serializeInit(bool);
 
   bool states_special = false;
+  unsigned frameCounter = 0;
 };
 
 extern System system;